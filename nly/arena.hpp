@@ -0,0 +1,209 @@
+#ifndef NLY_ARENA
+#define NLY_ARENA
+
+#include <memory>
+#include <cassert>
+#include <cstddef>
+#include <memory_resource>
+
+namespace nly
+{
+
+// Bump-pointer allocator for objects sharing one lifetime, such as everything built for a single
+// request. Deallocation does nothing, reset releases everything at once and keeps the blocks for
+// reuse.
+// Blocks are requested from upstream, use a memory_pool_resource whose node size is block_size to
+// draw them from a memory_pool.
+// Note: The destructors of the objects are not called by reset.
+class arena : public std::pmr::memory_resource
+{
+public:
+  /**
+   * @param block_size The size of a single block requested from upstream, allocations that don't
+   * fit in a block get a block of their own which is released by reset.
+   *
+   * @param initial_buffer Used before any block is requested, it may be null.
+   */
+  arena(
+    size_t                     block_size = 4096,
+    std::pmr::memory_resource* upstream = std::pmr::new_delete_resource(),
+    void*                      initial_buffer = nullptr,
+    size_t                     initial_size = 0)
+    : block_size_(block_size)
+    , upstream_(upstream)
+    , initial_buffer_(static_cast<char*>(initial_buffer))
+    , initial_size_(initial_buffer ? initial_size : 0)
+  {
+    assert(block_size > header_size);
+    reset();
+  }
+
+  arena(const arena&) = delete;
+  arena& operator=(const arena&) = delete;
+
+  ~arena()
+  {
+    release();
+  }
+
+public:
+  // Release every allocation, the regular blocks are kept for reuse.
+  void reset()
+  {
+    free_list(large_blocks_);
+
+    current_block_ = nullptr;
+    current_ = initial_buffer_;
+    end_ = initial_buffer_ + initial_size_;
+    allocated_byte_ = 0;
+  }
+
+  // Release every allocation and return every block to upstream.
+  void release()
+  {
+    reset();
+    free_list(blocks_);
+  }
+
+  // the number of bytes allocated since the last reset.
+  size_t allocated_byte() const
+  {
+    return allocated_byte_;
+  }
+
+  size_t block_size() const
+  {
+    return block_size_;
+  }
+
+  std::pmr::memory_resource* upstream() const
+  {
+    return upstream_;
+  }
+
+protected:
+  void* do_allocate(size_t bytes, size_t alignment) override
+  {
+    allocated_byte_ += bytes;
+
+    void* p = current_;
+    auto  space = static_cast<size_t>(end_ - current_);
+    if (current_ && std::align(alignment, bytes, p, space))
+    {
+      current_ = static_cast<char*>(p) + bytes;
+      return p;
+    }
+
+    const auto extra = alignment > alignof(block_type) ? alignment : 0;
+    if (header_size + bytes + extra > block_size_)
+    {
+      return large_block(bytes, alignment, extra);
+    }
+
+    next_block();
+
+    p = current_;
+    space = static_cast<size_t>(end_ - current_);
+    p = std::align(alignment, bytes, p, space);
+    assert(p);
+
+    current_ = static_cast<char*>(p) + bytes;
+    return p;
+  }
+
+  void do_deallocate(void*, size_t, size_t) override
+  {
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+  {
+    return this == &other;
+  }
+
+private:
+  struct alignas(std::max_align_t) block_type
+  {
+    block_type* next;
+    size_t      size;
+  };
+
+  static constexpr size_t header_size = sizeof(block_type);
+
+  block_type* new_block(size_t size)
+  {
+    auto block = static_cast<block_type*>(upstream_->allocate(size, alignof(block_type)));
+    block->next = nullptr;
+    block->size = size;
+    return block;
+  }
+
+  void free_list(block_type*& head)
+  {
+    while (head)
+    {
+      auto next = head->next;
+      upstream_->deallocate(head, head->size, alignof(block_type));
+      head = next;
+    }
+  }
+
+  // An allocation that doesn't fit in a regular block, the current block is kept.
+  void* large_block(size_t bytes, size_t alignment, size_t extra)
+  {
+    auto block = new_block(header_size + bytes + extra);
+    block->next = large_blocks_;
+    large_blocks_ = block;
+
+    void* p = block + 1;
+    auto  space = bytes + extra;
+    return std::align(alignment, bytes, p, space);
+  }
+
+  void next_block()
+  {
+    // the blocks after the current one were used before the last reset.
+    auto next = current_block_ ? current_block_->next : blocks_;
+    if (!next)
+    {
+      next = new_block(block_size_);
+      (current_block_ ? current_block_->next : blocks_) = next;
+    }
+
+    current_block_ = next;
+    current_ = reinterpret_cast<char*>(next + 1);
+    end_ = reinterpret_cast<char*>(next) + block_size_;
+  }
+
+private:
+  const size_t               block_size_;
+  std::pmr::memory_resource* upstream_;
+  char* const                initial_buffer_;
+  const size_t               initial_size_;
+
+  block_type* blocks_{ nullptr };
+  block_type* large_blocks_{ nullptr };
+  block_type* current_block_{ nullptr };
+  char*       current_{ nullptr };
+  char*       end_{ nullptr };
+  size_t      allocated_byte_{ 0 };
+};
+
+// arena whose initial buffer of t_size bytes lives inside the object, for example on the stack.
+template<size_t t_size>
+class inline_arena : public arena
+{
+public:
+  inline_arena(
+    size_t                     block_size = 4096,
+    std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+    : arena(block_size, upstream, buffer_, t_size)
+  {
+  }
+
+private:
+  alignas(std::max_align_t) char buffer_[t_size];
+};
+
+} // namespace nly
+
+#endif // NLY_ARENA
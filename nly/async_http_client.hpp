@@ -0,0 +1,304 @@
+#ifndef NLY_ASYNC_HTTP_CLIENT
+#define NLY_ASYNC_HTTP_CLIENT
+
+#include "nly/network.hpp"
+#include <map>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <utility>
+#include <functional>
+
+namespace nly
+{
+
+// Cancels the requests of async_http_client it is passed to, cancel may be called from any thread.
+// A request started after cancel fails at once.
+class http_cancellation
+{
+public:
+  void cancel()
+  {
+    std::map<size_t, std::function<void()>> callbacks;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      cancelled_ = true;
+      callbacks.swap(callbacks_);
+    }
+
+    for (auto& item : callbacks)
+    {
+      item.second();
+    }
+  }
+
+  bool is_cancelled()
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return cancelled_;
+  }
+
+  // the number of running requests cancel would stop.
+  size_t pending_count()
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return callbacks_.size();
+  }
+
+private:
+  friend class async_http_client;
+
+  // f is called once by cancel, or at once if cancel was already called.
+  // return: the id removing f, 0 if f was called.
+  size_t on_cancel(std::function<void()> f)
+  {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (!cancelled_)
+      {
+        callbacks_.emplace(++last_id_, std::move(f));
+        return last_id_;
+      }
+    }
+    f();
+    return 0;
+  }
+
+  // removes the callback of id, a request which completed doesn't need it anymore.
+  void remove(size_t id)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    callbacks_.erase(id);
+  }
+
+private:
+  std::mutex                              mutex_;
+  bool                                    cancelled_{ false };
+  size_t                                  last_id_{ 0 };
+  std::map<size_t, std::function<void()>> callbacks_;
+};
+
+// HTTP client running any number of requests concurrently on a shared io_context, which may be
+// run by several threads. Every request has a connection of its own and a deadline, it completes
+// with (boost::system::error_code, beast_http::response) through an asio completion token: a
+// callback, boost::asio::use_future, or boost::asio::use_awaitable in C++20 coroutines.
+// The error is timed_out if the deadline passed and operation_aborted if it was cancelled.
+class async_http_client
+{
+public:
+  explicit async_http_client(boost::asio::io_context& cxt)
+    : m_cxt(cxt)
+  {
+  }
+
+public:
+  boost::asio::io_context& get_io_context() const
+  {
+    return m_cxt;
+  }
+
+  // Connects to the first endpoint accepting the connection, sends req and reads the response.
+  template<
+    typename RepBody = beast_http::string_body,
+    typename RepFields = beast_http::fields,
+    typename ReqBody,
+    typename ReqFields,
+    typename t_token>
+  auto async_deal_command(
+    std::vector<boost::asio::ip::tcp::endpoint> endpoints,
+    beast_http::request<ReqBody, ReqFields>     req,
+    std::chrono::milliseconds                   max_wait_time,
+    std::shared_ptr<http_cancellation>          cancellation,
+    t_token&&                                   token)
+  {
+    typedef beast_http::response<RepBody, RepFields> response_type;
+
+    return boost::asio::async_initiate<t_token, void(boost::system::error_code, response_type)>(
+      [this](
+        auto                                        handler,
+        std::vector<boost::asio::ip::tcp::endpoint> endpoints,
+        beast_http::request<ReqBody, ReqFields>     req,
+        std::chrono::milliseconds                   max_wait_time,
+        std::shared_ptr<http_cancellation>          cancellation)
+      {
+        typedef session<ReqBody, ReqFields, RepBody, RepFields, decltype(handler)> session_type;
+
+        std::make_shared<session_type>(
+          m_cxt,
+          std::move(endpoints),
+          std::move(req),
+          std::move(handler))
+          ->start(max_wait_time, cancellation);
+      },
+      token,
+      std::move(endpoints),
+      std::move(req),
+      max_wait_time,
+      std::move(cancellation));
+  }
+
+  template<
+    typename RepBody = beast_http::string_body,
+    typename RepFields = beast_http::fields,
+    typename ReqBody,
+    typename ReqFields,
+    typename t_token>
+  auto async_deal_command(
+    std::vector<boost::asio::ip::tcp::endpoint> endpoints,
+    beast_http::request<ReqBody, ReqFields>     req,
+    std::chrono::milliseconds                   max_wait_time,
+    t_token&&                                   token)
+  {
+    return async_deal_command<RepBody, RepFields>(
+      std::move(endpoints),
+      std::move(req),
+      max_wait_time,
+      nullptr,
+      std::forward<t_token>(token));
+  }
+
+private:
+  // A single request, every handler runs on the strand of the request.
+  template<
+    typename ReqBody,
+    typename ReqFields,
+    typename RepBody,
+    typename RepFields,
+    typename t_handler>
+  class session : public std::enable_shared_from_this<
+                    session<ReqBody, ReqFields, RepBody, RepFields, t_handler>>
+  {
+  public:
+    session(
+      boost::asio::io_context&                    cxt,
+      std::vector<boost::asio::ip::tcp::endpoint> endpoints,
+      beast_http::request<ReqBody, ReqFields>     req,
+      t_handler                                   handler)
+      : m_strand(boost::asio::make_strand(cxt))
+      , m_sock(m_strand)
+      , m_timer(m_strand)
+      , m_endpoints(std::move(endpoints))
+      , m_req(std::move(req))
+      , m_handler(std::move(handler))
+    {
+    }
+
+  public:
+    void start(std::chrono::milliseconds max_wait_time, std::shared_ptr<http_cancellation> cancel)
+    {
+      auto self = this->shared_from_this();
+      boost::asio::dispatch(
+        m_strand,
+        [self, max_wait_time, cancel]()
+        {
+          // registered on the strand, so finish sees the id.
+          if (cancel)
+          {
+            std::weak_ptr<session> weak = self;
+            self->m_cancel = cancel;
+            self->m_cancel_id = cancel->on_cancel(
+              [weak]()
+              {
+                if (auto self = weak.lock())
+                {
+                  boost::asio::post(
+                    self->m_strand,
+                    [self]() { self->finish(boost::asio::error::operation_aborted); });
+                }
+              });
+          }
+
+          self->m_timer.expires_after(max_wait_time);
+          self->m_timer.async_wait(
+            [self](boost::system::error_code ec)
+            {
+              if (!ec)
+              {
+                self->finish(boost::asio::error::timed_out);
+              }
+            });
+
+          boost::asio::async_connect(
+            self->m_sock,
+            self->m_endpoints,
+            [self](boost::system::error_code ec, const boost::asio::ip::tcp::endpoint&)
+            { self->on_connect(ec); });
+        });
+    }
+
+  private:
+    void on_connect(boost::system::error_code ec)
+    {
+      if (ec || m_done)
+      {
+        return finish(ec);
+      }
+
+      auto self = this->shared_from_this();
+      beast_http::async_write(
+        m_sock,
+        m_req,
+        [self](boost::system::error_code ec, std::size_t) { self->on_write(ec); });
+    }
+
+    void on_write(boost::system::error_code ec)
+    {
+      if (ec || m_done)
+      {
+        return finish(ec);
+      }
+
+      auto self = this->shared_from_this();
+      beast_http::async_read(
+        m_sock,
+        m_buffer,
+        m_rep,
+        [self](boost::system::error_code ec, std::size_t) { self->finish(ec); });
+    }
+
+    // the first call completes the request, the handlers cancelled by it call it again.
+    void finish(boost::system::error_code ec)
+    {
+      if (m_done)
+      {
+        return;
+      }
+      m_done = true;
+
+      boost::system::error_code ignore;
+      m_timer.cancel();
+      m_sock.close(ignore);
+      if (m_cancel_id)
+      {
+        m_cancel->remove(m_cancel_id);
+      }
+
+      auto executor = boost::asio::get_associated_executor(m_handler, m_strand);
+      boost::asio::post(
+        executor,
+        [handler = std::move(m_handler), ec, rep = std::move(m_rep)]() mutable
+        { handler(ec, std::move(rep)); });
+    }
+
+  private:
+    boost::asio::strand<boost::asio::io_context::executor_type> m_strand;
+    boost::asio::ip::tcp::socket                                 m_sock;
+    boost::asio::steady_timer                                    m_timer;
+    std::vector<boost::asio::ip::tcp::endpoint>                  m_endpoints;
+    beast_http::request<ReqBody, ReqFields>                      m_req;
+    beast_http::response<RepBody, RepFields>                     m_rep;
+    boost::beast::flat_buffer                                    m_buffer;
+    t_handler                                                    m_handler;
+    std::shared_ptr<http_cancellation>                           m_cancel;
+    size_t                                                       m_cancel_id{ 0 };
+    bool                                                         m_done{ false };
+  };
+
+private:
+  boost::asio::io_context& m_cxt;
+};
+
+} // namespace nly
+
+#endif // NLY_ASYNC_HTTP_CLIENT
@@ -0,0 +1,308 @@
+#ifndef NLY_DNS_CACHE
+#define NLY_DNS_CACHE
+
+#include "nly/network.hpp"
+#include <map>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <condition_variable>
+
+namespace nly
+{
+
+// Cache of http_client::resolve keyed by (host, service), use dns_cache::global() to share it in
+// the process, and http_client::set_resolver to resolve the hosts of set_host through it.
+// An entry is refreshed on a background thread when it gets within refresh_ahead of its expiry, so
+// hot hosts are never resolved on the request path. Failed resolutions are cached for negative_ttl,
+// and if the resolver fails for a host that was resolved before, the stale endpoints are returned.
+// A host is resolved by a single thread at a time, the others looking it up meanwhile get the stale
+// endpoints, or wait for the resolution if there are none.
+// Lookups don't lock: every thread keeps the last published snapshot of the cache and only takes
+// the lock to fetch a new one after a change.
+class dns_cache
+{
+public:
+  typedef std::vector<boost::asio::ip::tcp::endpoint> endpoints_type;
+
+  // (host, service, max_wait_time) -> endpoints, empty if it failed.
+  typedef std::function<
+    endpoints_type(const std::string&, const std::string&, std::chrono::milliseconds)>
+    resolver_type;
+
+public:
+  /**
+   * @param ttl How long resolved endpoints are used.
+   *
+   * @param negative_ttl How long a failed resolution is remembered before it is tried again.
+   *
+   * @param refresh_ahead An entry used within this time before its expiry is refreshed in the
+   * background.
+   *
+   * @param resolver Resolves a host, http_client::resolve by default.
+   */
+  dns_cache(
+    std::chrono::milliseconds ttl = std::chrono::milliseconds(60000),
+    std::chrono::milliseconds negative_ttl = std::chrono::milliseconds(5000),
+    std::chrono::milliseconds refresh_ahead = std::chrono::milliseconds(10000),
+    resolver_type             resolver = nullptr)
+    : ttl_(ttl)
+    , negative_ttl_(negative_ttl)
+    , refresh_ahead_(refresh_ahead)
+    , resolver_(resolver ? std::move(resolver) : default_resolver())
+    , id_(next_id())
+    , snapshot_(std::make_shared<const map_type>())
+  {
+  }
+
+  dns_cache(const dns_cache&) = delete;
+  dns_cache& operator=(const dns_cache&) = delete;
+
+  ~dns_cache()
+  {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    if (refresher_.joinable())
+    {
+      refresher_.join();
+    }
+  }
+
+  // the cache shared by the process.
+  static dns_cache& global()
+  {
+    static dns_cache cache;
+    return cache;
+  }
+
+public:
+  // return: the endpoints of host, empty if it can't be resolved.
+  // Note: max_wait_time only applies if host is resolved on the calling thread.
+  endpoints_type resolve(
+    const std::string&        host,
+    const std::string&        service = "http",
+    std::chrono::milliseconds max_wait_time = std::chrono::milliseconds(5000))
+  {
+    auto key = std::make_pair(host, service);
+    auto now = nly::now();
+
+    auto record = find(key);
+    if (record && now < record->expiry)
+    {
+      if (!record->endpoints.empty() && now >= record->expiry - refresh_ahead_)
+      {
+        refresh_later(key, max_wait_time);
+      }
+      return record->endpoints;
+    }
+
+    // unknown or expired, resolve it here unless another thread already does.
+    auto stale = record ? record->endpoints : endpoints_type();
+    {
+      std::unique_lock<std::mutex> guard(mutex_);
+      auto                         it = snapshot_->find(key);
+      if (it != snapshot_->end() && nly::now() < it->second->expiry)
+      {
+        return it->second->endpoints;
+      }
+
+      if (!resolving_.insert(key).second)
+      {
+        if (!stale.empty())
+        {
+          return stale;
+        }
+
+        resolved_cv_.wait_until(
+          guard,
+          now + max_wait_time,
+          [this, &key]() { return !resolving_.count(key); });
+        it = snapshot_->find(key);
+        return it == snapshot_->end() ? stale : it->second->endpoints;
+      }
+    }
+
+    auto endpoints = resolver_(host, service, max_wait_time);
+    if (!endpoints.empty())
+    {
+      store(key, std::make_shared<const record_type>(record_type{ endpoints, now + ttl_ }), true);
+      return endpoints;
+    }
+
+    // the stale endpoints are better than nothing, they are kept until a resolution succeeds.
+    auto expiry = now + negative_ttl_;
+    store(key, std::make_shared<const record_type>(record_type{ stale, expiry }), true);
+    return stale;
+  }
+
+  // A resolver for http_client::set_resolver looking hosts up in the cache, which must outlive it.
+  http_client::resolver_type resolver()
+  {
+    return [this](
+             const std::string& host, const std::string& service, std::chrono::milliseconds wait)
+    { return resolve(host, service, wait); };
+  }
+
+  // forgets every entry.
+  void clear()
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    snapshot_ = std::make_shared<const map_type>();
+    ++version_;
+  }
+
+  // the number of resolutions done by the background thread.
+  size_t refresh_count() const
+  {
+    return refresh_count_;
+  }
+
+private:
+  typedef std::pair<std::string, std::string> key_type;
+
+  struct record_type
+  {
+    endpoints_type  endpoints;
+    nly::time_point expiry;
+  };
+
+  typedef std::map<key_type, std::shared_ptr<const record_type>> map_type;
+
+  // the snapshot of the cache last used by the thread, a thread only remembers a single cache.
+  struct local_type
+  {
+    size_t                          id{ 0 };
+    unsigned long long              version{ 0 };
+    std::shared_ptr<const map_type> snapshot;
+  };
+
+  static resolver_type default_resolver()
+  {
+    return [](const std::string& host, const std::string& service, std::chrono::milliseconds wait)
+    { return http_client::resolve(host, service, wait); };
+  }
+
+  static size_t next_id()
+  {
+    static std::atomic<size_t> id{ 0 };
+    return ++id;
+  }
+
+  std::shared_ptr<const record_type> find(const key_type& key)
+  {
+    thread_local local_type local;
+    if (local.id != id_ || local.version != version_.load(std::memory_order_acquire))
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      local.id = id_;
+      local.version = version_;
+      local.snapshot = snapshot_;
+    }
+
+    auto it = local.snapshot->find(key);
+    return it == local.snapshot->end() ? nullptr : it->second;
+  }
+
+  // publishes a new snapshot with record, the snapshots are small since there are few hosts.
+  // resolved: record is the result of a resolution on the calling thread of resolve, the threads
+  // waiting for it are woken up.
+  void store(
+    const key_type&                    key,
+    std::shared_ptr<const record_type> record,
+    const bool                         resolved = false)
+  {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      auto                        snapshot = std::make_shared<map_type>(*snapshot_);
+      (*snapshot)[key] = std::move(record);
+      snapshot_ = std::move(snapshot);
+      version_.fetch_add(1, std::memory_order_release);
+      if (!resolved)
+      {
+        return;
+      }
+      resolving_.erase(key);
+    }
+    resolved_cv_.notify_all();
+  }
+
+  void refresh_later(const key_type& key, std::chrono::milliseconds max_wait_time)
+  {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (stop_ || !refreshing_.insert(key).second)
+      {
+        return;
+      }
+
+      queue_.emplace_back(key, max_wait_time);
+      if (!refresher_.joinable())
+      {
+        refresher_ = std::thread([this]() { this->run(); });
+      }
+    }
+    cv_.notify_one();
+  }
+
+  void run()
+  {
+    std::unique_lock<std::mutex> guard(mutex_);
+    while (true)
+    {
+      cv_.wait(guard, [this]() { return stop_ || !queue_.empty(); });
+      if (stop_)
+      {
+        return;
+      }
+
+      auto [key, max_wait_time] = std::move(queue_.front());
+      queue_.pop_front();
+
+      guard.unlock();
+      auto endpoints = resolver_(key.first, key.second, max_wait_time);
+      ++refresh_count_;
+      if (!endpoints.empty())
+      {
+        auto expiry = nly::now() + ttl_;
+        store(key, std::make_shared<const record_type>(record_type{ endpoints, expiry }));
+      }
+      guard.lock();
+
+      // if it failed, the entry expires and the next lookup falls back to the stale endpoints.
+      refreshing_.erase(key);
+    }
+  }
+
+private:
+  const std::chrono::milliseconds ttl_;
+  const std::chrono::milliseconds negative_ttl_;
+  const std::chrono::milliseconds refresh_ahead_;
+  const resolver_type             resolver_;
+  const size_t                    id_;
+
+  std::mutex                                                 mutex_;
+  std::shared_ptr<const map_type>                            snapshot_;
+  std::atomic<unsigned long long>                            version_{ 1 };
+  std::condition_variable                                    cv_;
+  std::deque<std::pair<key_type, std::chrono::milliseconds>> queue_;
+  std::set<key_type>                                         refreshing_;
+  std::set<key_type>                                         resolving_;
+  std::condition_variable                                    resolved_cv_;
+  std::atomic<size_t>                                        refresh_count_{ 0 };
+  bool                                                       stop_{ false };
+  std::thread                                                refresher_;
+};
+
+} // namespace nly
+
+#endif // NLY_DNS_CACHE
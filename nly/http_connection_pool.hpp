@@ -0,0 +1,353 @@
+#ifndef NLY_HTTP_CONNECTION_POOL
+#define NLY_HTTP_CONNECTION_POOL
+
+#include "nly/network.hpp"
+#include "nly/dns_cache.hpp"
+#include <map>
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <condition_variable>
+
+namespace nly
+{
+
+// Keep-alive connections shared by the threads talking to a set of hosts, keyed by host:service.
+// An idle connection is checked on checkout, connections the server closed meanwhile are dropped
+// and replaced by new ones. Hosts are resolved through dns_cache::global().
+class http_connection_pool
+{
+public:
+  // A connection checked out of the pool, it goes back to the pool on destruction if it is still
+  // connected. Close the client to drop it, for example after a response without keep-alive.
+  class connection
+  {
+  public:
+    connection() = default;
+
+    connection(connection&&) = default;
+    connection& operator=(connection&& other)
+    {
+      if (this != &other)
+      {
+        give_back();
+        pool_ = other.pool_;
+        key_ = std::move(other.key_);
+        client_ = std::move(other.client_);
+        reused_ = other.reused_;
+        other.pool_ = nullptr;
+      }
+      return *this;
+    }
+
+    ~connection()
+    {
+      give_back();
+    }
+
+  public:
+    explicit operator bool() const
+    {
+      return client_ != nullptr;
+    }
+
+    http_client& operator*() const
+    {
+      return *client_;
+    }
+
+    http_client* operator->() const
+    {
+      return client_.get();
+    }
+
+    // whether the connection served a request before this checkout.
+    bool reused() const
+    {
+      return reused_;
+    }
+
+  private:
+    friend class http_connection_pool;
+
+    connection(
+      http_connection_pool*        pool,
+      std::string                  key,
+      std::unique_ptr<http_client> client,
+      bool                         reused)
+      : pool_(pool)
+      , key_(std::move(key))
+      , client_(std::move(client))
+      , reused_(reused)
+    {
+    }
+
+    void give_back()
+    {
+      if (pool_ && client_)
+      {
+        pool_->give_back(key_, std::move(client_));
+      }
+      pool_ = nullptr;
+    }
+
+  private:
+    http_connection_pool*        pool_{ nullptr };
+    std::string                  key_;
+    std::unique_ptr<http_client> client_;
+    bool                         reused_{ false };
+  };
+
+public:
+  /**
+   * @param max_per_host The maximum number of connections open to a host:service at a time, idle
+   * or checked out, acquire waits for one to be returned beyond it.
+   *
+   * @param idle_timeout Idle connections older than it are closed instead of reused.
+   *
+   * @param options Set on every connection, with TCP keepalive by default so the idle connections
+   * a peer or a middlebox dropped are noticed.
+   */
+  http_connection_pool(
+    size_t                    max_per_host = 8,
+    std::chrono::milliseconds idle_timeout = std::chrono::milliseconds(30000),
+    const socket_options&     options = socket_options::pooled())
+    : max_per_host_(max_per_host ? max_per_host : 1)
+    , idle_timeout_(idle_timeout)
+    , socket_options_(options)
+  {
+  }
+
+  http_connection_pool(const http_connection_pool&) = delete;
+  http_connection_pool& operator=(const http_connection_pool&) = delete;
+
+  // Note: Every connection must be returned before the pool is destroyed.
+  ~http_connection_pool() = default;
+
+public:
+  // Checks out a connection to host:service, a new one is connected if no idle one is usable.
+  // return: an empty connection if max_wait_time passed or the host can't be connected.
+  connection acquire(
+    const std::string&        host,
+    const std::string&        service = "http",
+    std::chrono::milliseconds max_wait_time = std::chrono::milliseconds(5000))
+  {
+    const auto deadline = nly::now() + max_wait_time;
+    auto       key = host + ":" + service;
+
+    // the unusable idle connections, closed after the lock is released.
+    std::vector<std::unique_ptr<http_client>> stale;
+    {
+      std::unique_lock<std::mutex> guard(mutex_);
+      auto&                        entry = hosts_[key];
+      while (true)
+      {
+        // the most recently returned connection is the least likely to be closed by the server.
+        while (!entry.idle.empty())
+        {
+          auto item = std::move(entry.idle.back());
+          entry.idle.pop_back();
+
+          if (nly::now() - item.since < idle_timeout_ && healthy(*item.client))
+          {
+            return connection(this, key, std::move(item.client), true);
+          }
+
+          --entry.open_count;
+          stale.emplace_back(std::move(item.client));
+        }
+
+        if (entry.open_count < max_per_host_)
+        {
+          break;
+        }
+
+        if (cv_.wait_until(guard, deadline) == std::cv_status::timeout)
+        {
+          return {};
+        }
+      }
+
+      ++entry.open_count;
+    }
+    stale.clear();
+
+    auto client = std::make_unique<http_client>();
+    client->set_socket_options(socket_options_);
+    if (
+      !client->set_host(dns_cache::global().resolve(host, service, remaining(deadline))) ||
+      !client->connect(remaining(deadline)))
+    {
+      give_back(key, nullptr);
+      return {};
+    }
+
+    return connection(this, key, std::move(client), false);
+  }
+
+  // deal_command of http_client on a connection of the pool. A connection the server closed
+  // without a response is replaced by a new one and the request sent again, if the method is
+  // idempotent.
+  template<
+    typename ReqBody,
+    typename ReqFields,
+    typename RepBody = beast_http::string_body,
+    typename RepFields = beast_http::fields>
+  std::optional<beast_http::response<RepBody, RepFields>> deal_command(
+    const std::string&                             host,
+    const std::string&                             service,
+    const beast_http::request<ReqBody, ReqFields>& req,
+    std::chrono::milliseconds                      max_wait_time = std::chrono::milliseconds(5000),
+    const std::function<bool()>&                   early_terminate = nullptr)
+  {
+    const auto deadline = nly::now() + max_wait_time;
+
+    while (true)
+    {
+      auto conn = acquire(host, service, remaining(deadline));
+      if (!conn)
+      {
+        return {};
+      }
+
+      auto rep = conn->template deal_command<ReqBody, ReqFields, RepBody, RepFields>(
+        req,
+        remaining(deadline),
+        early_terminate);
+      if (rep)
+      {
+        if (!rep->keep_alive())
+        {
+          conn->close();
+        }
+        return rep;
+      }
+
+      if (!conn.reused() || !idempotent(req.method()) || nly::now() >= deadline)
+      {
+        return {};
+      }
+    }
+  }
+
+  // closes the idle connections, the checked out ones are not affected.
+  void clear()
+  {
+    std::map<std::string, host_type> hosts;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      for (auto& item : hosts_)
+      {
+        item.second.open_count -= item.second.idle.size();
+        hosts[item.first].idle = std::move(item.second.idle);
+        item.second.idle.clear();
+      }
+    }
+    cv_.notify_all();
+  }
+
+  // the number of idle connections to every host.
+  size_t idle_count()
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    size_t result = 0;
+    for (auto& item : hosts_)
+    {
+      result += item.second.idle.size();
+    }
+    return result;
+  }
+
+private:
+  struct idle_type
+  {
+    std::unique_ptr<http_client> client;
+    nly::time_point              since;
+  };
+
+  struct host_type
+  {
+    std::deque<idle_type> idle;
+    size_t                open_count{ 0 };
+  };
+
+  static std::chrono::milliseconds remaining(nly::time_point deadline)
+  {
+    auto result = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - nly::now());
+    return (std::max)(result, std::chrono::milliseconds(0));
+  }
+
+  static bool idempotent(beast_http::verb method)
+  {
+    switch (method)
+    {
+    case beast_http::verb::get:
+    case beast_http::verb::head:
+    case beast_http::verb::put:
+    case beast_http::verb::delete_:
+    case beast_http::verb::options:
+    case beast_http::verb::trace:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // An idle connection is usable if nothing can be read from it, a closed connection reads the end
+  // of stream and a broken one an error.
+  static bool healthy(http_client& client)
+  {
+    auto& sock = client.get_socket();
+    if (!client.is_connected() || !sock.is_open())
+    {
+      return false;
+    }
+
+    char                      byte = 0;
+    boost::system::error_code ec;
+    sock.non_blocking(true, ec);
+    sock.receive(
+      boost::asio::buffer(&byte, 1),
+      boost::asio::ip::tcp::socket::message_peek,
+      ec);
+    boost::system::error_code restore_ec;
+    sock.non_blocking(false, restore_ec);
+
+    return ec == boost::asio::error::would_block;
+  }
+
+  // client is null if it was never connected.
+  void give_back(const std::string& key, std::unique_ptr<http_client> client)
+  {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      auto&                       entry = hosts_[key];
+      if (client && client->is_connected())
+      {
+        entry.idle.push_back({ std::move(client), nly::now() });
+      }
+      else
+      {
+        --entry.open_count;
+      }
+    }
+    cv_.notify_one();
+  }
+
+private:
+  const size_t                     max_per_host_;
+  const std::chrono::milliseconds  idle_timeout_;
+  const socket_options             socket_options_;
+  std::mutex                       mutex_;
+  std::condition_variable          cv_;
+  std::map<std::string, host_type> hosts_;
+};
+
+} // namespace nly
+
+#endif // NLY_HTTP_CONNECTION_POOL
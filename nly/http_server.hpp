@@ -0,0 +1,544 @@
+#ifndef NLY_HTTP_SERVER
+#define NLY_HTTP_SERVER
+
+#include "nly/network.hpp"
+#include <map>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <string_view>
+#include <unordered_set>
+
+namespace nly
+{
+
+// The limits and the threads of http_server.
+struct http_server_options
+{
+  // 0 means one thread per core.
+  size_t thread_count{ 0 };
+
+  // connections accepted beyond it are closed at once.
+  size_t max_connection{ 10000 };
+
+  // larger requests are answered with 413 and the connection is closed.
+  size_t max_body_byte{ 1024 * 1024 };
+
+  size_t max_header_byte{ 8 * 1024 };
+
+  // a connection waiting for the header of a request longer than it is closed.
+  std::chrono::milliseconds idle_timeout{ 30000 };
+
+  // the body of a request is read within it once its header is, or the connection is closed.
+  std::chrono::milliseconds body_timeout{ 60000 };
+
+  // one listener per thread with SO_REUSEPORT, where it is supported.
+  bool reuse_port{ true };
+
+  // set on every accepted connection.
+  socket_options socket;
+};
+
+// HTTP/1.1 server running one io_context per thread.
+// On Linux every thread has its own listener bound with SO_REUSEPORT and the kernel spreads the
+// connections, elsewhere a single acceptor hands them out to the threads in turn. A connection
+// stays on its thread, so its handlers are never run concurrently.
+// Connections are kept alive and pipelined requests are answered in order.
+class http_server
+{
+public:
+  typedef beast_http::request<beast_http::string_body>  request_type;
+  typedef beast_http::response<beast_http::string_body> response_type;
+
+  // Completes a request, it may be called from any thread, only the first call counts. It does
+  // nothing once the server is stopped.
+  typedef std::function<void(response_type)> responder_type;
+
+  // The request is valid until the responder is called.
+  typedef std::function<void(request_type&, responder_type)>  async_handler_type;
+  typedef std::function<response_type(const request_type&)> handler_type;
+
+  typedef http_server_options options;
+
+public:
+  http_server(const options& opt = options())
+    : options_(opt)
+    , state_(std::make_shared<shared_state>())
+  {
+    if (!options_.thread_count)
+    {
+      options_.thread_count = (std::max)(std::thread::hardware_concurrency(), 1u);
+    }
+  }
+
+  http_server(const http_server&) = delete;
+  http_server& operator=(const http_server&) = delete;
+
+  ~http_server()
+  {
+    stop();
+  }
+
+public:
+  // Answers method requests to path, the query string is ignored when matching.
+  // Note: The routes must be added before start.
+  void route(beast_http::verb method, const std::string& path, handler_type handler)
+  {
+    route_async(
+      method,
+      path,
+      [handler = std::move(handler)](request_type& req, responder_type respond)
+      { respond(handler(req)); });
+  }
+
+  // Same as route, but the handler completes the request by calling the responder, which it may
+  // do later from another thread.
+  void route_async(beast_http::verb method, const std::string& path, async_handler_type handler)
+  {
+    routes_[path][method] = std::move(handler);
+  }
+
+  // Listens on endpoint, a port of 0 picks a free port, see local_endpoint.
+  // return: false if it can't listen or the server was already started.
+  bool start(const boost::asio::ip::tcp::endpoint& endpoint)
+  {
+    if (!workers_.empty() || state_->stopped)
+    {
+      return false;
+    }
+
+    for (size_t i = 0; i < options_.thread_count; ++i)
+    {
+      workers_.emplace_back(std::make_unique<worker>());
+    }
+
+    auto listener_count = reuse_port_supported() && options_.reuse_port ? workers_.size() : 1;
+    auto bind_endpoint = endpoint;
+    for (size_t i = 0; i < listener_count; ++i)
+    {
+      if (!listen(*workers_[i], bind_endpoint, listener_count > 1))
+      {
+        workers_.clear();
+        return false;
+      }
+
+      // the other listeners share the port picked by the first one.
+      bind_endpoint = workers_[i]->acceptor->local_endpoint();
+    }
+    endpoint_ = bind_endpoint;
+    shared_acceptor_ = listener_count < workers_.size();
+
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+      if (workers_[i]->acceptor)
+      {
+        accept(*workers_[i]);
+      }
+
+      auto cxt = &workers_[i]->cxt;
+      workers_[i]->thread = std::thread([cxt]() { cxt->run(); });
+    }
+    return true;
+  }
+
+  // Stops the threads, the connections are closed and the pending requests are dropped.
+  // Note: A stopped server can't be started again.
+  void stop()
+  {
+    for (auto& item : workers_)
+    {
+      item->cxt.stop();
+    }
+
+    for (auto& item : workers_)
+    {
+      if (item->thread.joinable())
+      {
+        item->thread.join();
+      }
+    }
+
+    // A responder may keep a connection past the server, its socket and timer are released while
+    // their io_context is still there.
+    {
+      std::lock_guard<std::mutex> guard(state_->mutex);
+      state_->stopped = true;
+      for (auto item : state_->sessions)
+      {
+        item->detach();
+      }
+    }
+
+    // the other connections are destroyed with their io_context.
+    workers_.clear();
+  }
+
+  const boost::asio::ip::tcp::endpoint& local_endpoint() const
+  {
+    return endpoint_;
+  }
+
+  // the number of open connections.
+  size_t connection_count() const
+  {
+    return state_->connection_count;
+  }
+
+private:
+  class session;
+
+  // What the connections share with the server, a connection may outlive it.
+  struct shared_state
+  {
+    std::mutex                   mutex;
+    bool                         stopped{ false };
+    std::unordered_set<session*> sessions;
+    std::atomic<size_t>          connection_count{ 0 };
+  };
+
+  struct worker
+  {
+    boost::asio::io_context                                                  cxt;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> guard{
+      cxt.get_executor()
+    };
+    std::optional<boost::asio::ip::tcp::acceptor> acceptor;
+    std::thread                                   thread;
+  };
+
+  // A connection, every handler runs on the io_context of the connection.
+  class session : public std::enable_shared_from_this<session>
+  {
+  public:
+    session(
+      http_server&                           server,
+      boost::asio::io_context::executor_type executor,
+      boost::asio::ip::tcp::socket           sock)
+      : server_(server)
+      , state_(server.state_)
+      , executor_(executor)
+      , sock_(std::move(sock))
+      , timer_(std::in_place, executor)
+    {
+      std::lock_guard<std::mutex> guard(state_->mutex);
+      state_->sessions.insert(this);
+      ++state_->connection_count;
+    }
+
+    ~session()
+    {
+      std::lock_guard<std::mutex> guard(state_->mutex);
+      state_->sessions.erase(this);
+      --state_->connection_count;
+    }
+
+  public:
+    void read()
+    {
+      parser_.emplace();
+      parser_->body_limit(server_.options_.max_body_byte);
+      parser_->header_limit(static_cast<std::uint32_t>(server_.options_.max_header_byte));
+
+      close_after(server_.options_.idle_timeout);
+
+      auto self = this->shared_from_this();
+      beast_http::async_read_header(
+        *sock_,
+        buffer_,
+        *parser_,
+        [self](boost::system::error_code ec, std::size_t) { self->on_read_header(ec); });
+    }
+
+    // Releases the socket and the timer, the server is stopped and its threads are joined.
+    void detach()
+    {
+      sock_.reset();
+      timer_.reset();
+    }
+
+  private:
+    // closes the connection unless the timer is cancelled or set again before timeout.
+    void close_after(std::chrono::milliseconds timeout)
+    {
+      std::weak_ptr<session> weak = this->shared_from_this();
+      timer_->expires_after(timeout);
+      timer_->async_wait(
+        [weak](boost::system::error_code ec)
+        {
+          auto self = weak.lock();
+          if (!ec && self)
+          {
+            self->close();
+          }
+        });
+    }
+
+    // a slow body isn't an idle connection, it is read under body_timeout.
+    void on_read_header(boost::system::error_code ec)
+    {
+      if (ec || parser_->is_done())
+      {
+        return on_read(ec);
+      }
+
+      close_after(server_.options_.body_timeout);
+
+      auto self = this->shared_from_this();
+      beast_http::async_read(
+        *sock_,
+        buffer_,
+        *parser_,
+        [self](boost::system::error_code ec, std::size_t) { self->on_read(ec); });
+    }
+
+    void on_read(boost::system::error_code ec)
+    {
+      timer_->cancel();
+
+      if (ec == beast_http::error::body_limit)
+      {
+        return fail(beast_http::status::payload_too_large);
+      }
+
+      if (ec == beast_http::error::header_limit)
+      {
+        return fail(beast_http::status::request_header_fields_too_large);
+      }
+
+      // a malformed request, as opposed to a closed or broken connection.
+      const auto& http_category =
+        beast_http::make_error_code(beast_http::error::bad_target).category();
+      if (
+        ec && ec.category() == http_category && ec != beast_http::error::end_of_stream &&
+        ec != beast_http::error::partial_message)
+      {
+        return fail(beast_http::status::bad_request);
+      }
+
+      if (ec)
+      {
+        return close();
+      }
+
+      req_ = parser_->release();
+      keep_alive_ = req_.keep_alive();
+      server_.dispatch(req_, responder());
+    }
+
+    responder_type responder()
+    {
+      auto self = this->shared_from_this();
+      auto called = std::make_shared<std::atomic<bool>>(false);
+      return [self, called](response_type rep)
+      {
+        if (called->exchange(true))
+        {
+          return;
+        }
+
+        {
+          std::lock_guard<std::mutex> guard(self->state_->mutex);
+          if (self->state_->stopped)
+          {
+            return;
+          }
+
+          if (!self->executor_.running_in_this_thread())
+          {
+            boost::asio::post(
+              self->executor_,
+              [self, rep = std::move(rep)]() mutable { self->write(std::move(rep)); });
+            return;
+          }
+        }
+
+        // inline if called by a handler on the thread of the connection.
+        self->write(std::move(rep));
+      };
+    }
+
+    void write(response_type rep)
+    {
+      rep_ = std::move(rep);
+
+      // the handler may close the connection, it can't keep one the client closes.
+      keep_alive_ = keep_alive_ && rep_.keep_alive();
+      rep_.version(req_.version());
+      rep_.keep_alive(keep_alive_);
+      rep_.prepare_payload();
+
+      auto self = this->shared_from_this();
+      beast_http::async_write(
+        *sock_,
+        rep_,
+        [self](boost::system::error_code ec, std::size_t) { self->on_write(ec); });
+    }
+
+    void on_write(boost::system::error_code ec)
+    {
+      if (ec || !keep_alive_)
+      {
+        return close();
+      }
+
+      read();
+    }
+
+    // answers a request that couldn't be read, and closes the connection.
+    void fail(beast_http::status status)
+    {
+      keep_alive_ = false;
+      write(make_response_msg(std::string(beast_http::obsolete_reason(status)), status));
+    }
+
+    void close()
+    {
+      boost::system::error_code ignore;
+      sock_->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignore);
+      sock_->close(ignore);
+      timer_->cancel();
+    }
+
+  private:
+    typedef beast_http::request_parser<beast_http::string_body> parser_type;
+
+  private:
+    // only used on the thread of the connection, while the server runs.
+    http_server& server_;
+
+    std::shared_ptr<shared_state>               state_;
+    boost::asio::io_context::executor_type      executor_;
+    std::optional<boost::asio::ip::tcp::socket> sock_;
+    std::optional<boost::asio::steady_timer>    timer_;
+    boost::beast::flat_buffer                   buffer_;
+    std::optional<parser_type>                  parser_;
+    request_type                                req_;
+    response_type                               rep_;
+    bool                                        keep_alive_{ false };
+  };
+
+  static constexpr bool reuse_port_supported()
+  {
+#ifdef SO_REUSEPORT
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool listen(worker& w, const boost::asio::ip::tcp::endpoint& endpoint, bool reuse_port)
+  {
+    boost::system::error_code ec;
+
+    w.acceptor.emplace(w.cxt);
+    w.acceptor->open(endpoint.protocol(), ec);
+    if (!ec)
+    {
+      w.acceptor->set_option(boost::asio::socket_base::reuse_address(true), ec);
+    }
+#ifdef SO_REUSEPORT
+    if (!ec && reuse_port)
+    {
+      typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port_type;
+      w.acceptor->set_option(reuse_port_type(true), ec);
+    }
+#endif
+    if (!ec)
+    {
+      w.acceptor->bind(endpoint, ec);
+    }
+    if (!ec)
+    {
+      w.acceptor->listen(boost::asio::socket_base::max_listen_connections, ec);
+    }
+
+    return !ec;
+  }
+
+  void accept(worker& w)
+  {
+    // a shared acceptor hands the connections out to the threads in turn.
+    auto& target = shared_acceptor_ ? workers_[next_worker_++ % workers_.size()]->cxt : w.cxt;
+
+    w.acceptor->async_accept(
+      target,
+      [this, &w, &target](boost::system::error_code ec, boost::asio::ip::tcp::socket sock)
+      {
+        if (ec == boost::asio::error::operation_aborted)
+        {
+          return;
+        }
+
+        if (!ec)
+        {
+          if (state_->connection_count >= options_.max_connection)
+          {
+            sock.close(ec);
+          }
+          else
+          {
+            options_.socket.apply(sock);
+            auto executor = target.get_executor();
+            boost::asio::post(
+              executor,
+              [s = std::make_shared<session>(*this, executor, std::move(sock))]() { s->read(); });
+          }
+        }
+
+        accept(w);
+      });
+  }
+
+  void dispatch(request_type& req, responder_type respond)
+  {
+    auto target = req.target();
+    auto path = std::string_view(target.data(), target.size());
+    path = path.substr(0, path.find('?'));
+
+    auto it = routes_.find(path);
+    if (it == routes_.end())
+    {
+      return respond(make_response_msg("Not Found", beast_http::status::not_found));
+    }
+
+    auto handler = it->second.find(req.method());
+    if (handler == it->second.end())
+    {
+      return respond(
+        make_response_msg("Method Not Allowed", beast_http::status::method_not_allowed));
+    }
+
+    try
+    {
+      handler->second(req, respond);
+    }
+    catch (...)
+    {
+      respond(
+        make_response_msg("Internal Server Error", beast_http::status::internal_server_error));
+    }
+  }
+
+private:
+  // path -> method -> handler, looked up by std::string_view.
+  typedef std::map<std::string, std::map<beast_http::verb, async_handler_type>, std::less<>>
+    route_map;
+
+private:
+  options                              options_;
+  route_map                            routes_;
+  boost::asio::ip::tcp::endpoint       endpoint_;
+  std::shared_ptr<shared_state>        state_;
+  bool                                 shared_acceptor_{ false };
+  size_t                               next_worker_{ 0 };
+  std::vector<std::unique_ptr<worker>> workers_;
+};
+
+} // namespace nly
+
+#endif // NLY_HTTP_SERVER
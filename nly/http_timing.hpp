@@ -0,0 +1,194 @@
+#ifndef NLY_HTTP_TIMING
+#define NLY_HTTP_TIMING
+
+#include "nly/time/time_count.hpp"
+#include "nly/latency_histogram.hpp"
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <optional>
+
+namespace nly
+{
+
+// The time points of the phases of a request of http_client, see http_client::get_timing.
+// A phase that wasn't run, or didn't complete, is left at time_point().
+struct http_timing
+{
+  nly::time_point resolve_start;
+  nly::time_point resolve_end;
+  nly::time_point connect_start;
+  nly::time_point connect_end;
+  nly::time_point write_start;
+  nly::time_point write_end;
+
+  // the header of the response was read, which is the first byte for a header in one packet.
+  nly::time_point header_end;
+
+  // the whole response was read.
+  nly::time_point body_end;
+
+public:
+  // unit: microsecond, -1 if the phase didn't complete.
+  long long resolve_us() const
+  {
+    return span_us(resolve_start, resolve_end);
+  }
+
+  long long connect_us() const
+  {
+    return span_us(connect_start, connect_end);
+  }
+
+  long long write_us() const
+  {
+    return span_us(write_start, write_end);
+  }
+
+  // from the end of the write to the header of the response.
+  long long ttfb_us() const
+  {
+    return span_us(write_end, header_end);
+  }
+
+  long long body_us() const
+  {
+    return span_us(header_end, body_end);
+  }
+
+  // from the first phase run to the end of the response.
+  long long total_us() const
+  {
+    for (auto start : { resolve_start, connect_start, write_start })
+    {
+      if (start != nly::time_point())
+      {
+        return span_us(start, body_end);
+      }
+    }
+    return -1;
+  }
+
+private:
+  static long long span_us(nly::time_point start, nly::time_point end)
+  {
+    if (start == nly::time_point() || end == nly::time_point() || end < start)
+    {
+      return -1;
+    }
+    return nly::time_diff_us(start, end);
+  }
+};
+
+// Histograms of the phases of the requests to every host, share one between the http_client of a
+// process with http_client::set_timing_stats. It is thread safe, a record takes a lock and a few
+// histogram increments.
+class http_timing_stats
+{
+public:
+  // The latencies of the phases in microseconds, a phase that wasn't run is not recorded.
+  struct phases_type
+  {
+    latency_histogram resolve;
+    latency_histogram connect;
+    latency_histogram write;
+    latency_histogram ttfb;
+    latency_histogram body;
+    latency_histogram total;
+  };
+
+public:
+  /**
+   * @param highest_value The largest latency tracked, larger ones are recorded as it.
+   *
+   * @param significant_digits The precision of the histograms, see latency_histogram. The default
+   * keeps a host within about 100 KB.
+   */
+  http_timing_stats(
+    std::chrono::milliseconds highest_value = std::chrono::milliseconds(60000),
+    int                       significant_digits = 2)
+    : empty_(make_phases(highest_value, significant_digits))
+  {
+  }
+
+  http_timing_stats(const http_timing_stats&) = delete;
+  http_timing_stats& operator=(const http_timing_stats&) = delete;
+
+public:
+  void record(const std::string& host, const http_timing& timing)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    auto it = hosts_.find(host);
+    if (it == hosts_.end())
+    {
+      it = hosts_.emplace(host, empty_).first;
+    }
+
+    auto& phases = it->second;
+    record(phases.resolve, timing.resolve_us());
+    record(phases.connect, timing.connect_us());
+    record(phases.write, timing.write_us());
+    record(phases.ttfb, timing.ttfb_us());
+    record(phases.body, timing.body_us());
+    record(phases.total, timing.total_us());
+  }
+
+  // return: a copy of the histograms of host, empty if nothing was recorded for it.
+  std::optional<phases_type> get(const std::string& host) const
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    auto it = hosts_.find(host);
+    if (it == hosts_.end())
+    {
+      return {};
+    }
+    return it->second;
+  }
+
+  std::vector<std::string> hosts() const
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    std::vector<std::string> result;
+    for (auto& item : hosts_)
+    {
+      result.push_back(item.first);
+    }
+    return result;
+  }
+
+  void clear()
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    hosts_.clear();
+  }
+
+private:
+  static phases_type make_phases(std::chrono::milliseconds highest_value, int significant_digits)
+  {
+    latency_histogram histogram(
+      static_cast<std::uint64_t>(highest_value.count()) * 1000,
+      significant_digits);
+    return { histogram, histogram, histogram, histogram, histogram, histogram };
+  }
+
+  static void record(latency_histogram& histogram, long long value)
+  {
+    if (value >= 0)
+    {
+      histogram.record(static_cast<std::uint64_t>(value));
+    }
+  }
+
+private:
+  const phases_type                  empty_;
+  mutable std::mutex                 mutex_;
+  std::map<std::string, phases_type> hosts_;
+};
+
+} // namespace nly
+
+#endif // NLY_HTTP_TIMING
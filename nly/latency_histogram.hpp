@@ -0,0 +1,214 @@
+#ifndef NLY_LATENCY_HISTOGRAM
+#define NLY_LATENCY_HISTOGRAM
+
+#include "boost/core/bit.hpp"
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace nly
+{
+
+// Histogram of non-negative integer values, laid out as HdrHistogram: values are counted in
+// buckets of which the width doubles with every power of 2, so every recorded value is kept with
+// the requested number of significant decimal digits whatever its magnitude. Recording is O(1) and
+// doesn't allocate.
+// The unit is up to the caller, usually microseconds. It isn't thread safe, keep one per thread
+// and merge them.
+class latency_histogram
+{
+public:
+  /**
+   * @param highest_value The largest value tracked, larger values are recorded as it.
+   *
+   * @param significant_digits The precision of the recorded values, from 1 to 5.
+   */
+  latency_histogram(std::uint64_t highest_value = 3600ull * 1000 * 1000, int significant_digits = 3)
+    : highest_value_((std::max)(highest_value, std::uint64_t(2)))
+  {
+    significant_digits = (std::min)((std::max)(significant_digits, 1), 5);
+
+    // the smallest power of 2 which holds 2 * 10^digits sub buckets.
+    auto largest_single_unit = 2 * static_cast<std::uint64_t>(std::pow(10, significant_digits));
+    sub_bucket_magnitude_ = static_cast<int>(boost::core::bit_width(largest_single_unit - 1));
+    sub_bucket_half_magnitude_ = sub_bucket_magnitude_ - 1;
+    sub_bucket_mask_ = (std::uint64_t(1) << sub_bucket_magnitude_) - 1;
+
+    counts_.resize(index_of(highest_value_) + 1);
+  }
+
+public:
+  void record(std::uint64_t value, std::uint64_t count = 1)
+  {
+    value = (std::min)(value, highest_value_);
+    counts_[index_of(value)] += count;
+    total_count_ += count;
+    total_value_ += static_cast<double>(value) * count;
+    min_ = (std::min)(min_, value);
+    max_ = (std::max)(max_, value);
+  }
+
+  // Records value, and if it is larger than expected_interval, the values the samples which should
+  // have been taken meanwhile would have seen: value - expected_interval, value - 2 *
+  // expected_interval... That corrects the coordinated omission of a closed-loop load generator,
+  // which doesn't send requests while the server stalls.
+  void record_corrected(std::uint64_t value, std::uint64_t expected_interval)
+  {
+    record(value);
+    if (!expected_interval)
+    {
+      return;
+    }
+
+    for (auto missing = value; missing > expected_interval;)
+    {
+      missing -= expected_interval;
+      record(missing);
+    }
+  }
+
+  // return: a copy with the values record_corrected would have added for every recorded value, the
+  // added values are derived from the values as kept by the histogram. Like record_corrected, but
+  // for an expected_interval only known after recording, for example the mean itself.
+  latency_histogram corrected(std::uint64_t expected_interval) const
+  {
+    auto result = *this;
+    if (!expected_interval)
+    {
+      return result;
+    }
+
+    for (size_t i = 0; i < counts_.size(); ++i)
+    {
+      if (!counts_[i])
+      {
+        continue;
+      }
+
+      for (auto missing = (std::min)(highest_equivalent(i), max_); missing > expected_interval;)
+      {
+        missing -= expected_interval;
+        result.record(missing, counts_[i]);
+      }
+    }
+    return result;
+  }
+
+  // adds the values of other, it must have the same highest value and significant digits.
+  void merge(const latency_histogram& other)
+  {
+    if (other.counts_.size() != counts_.size() || other.sub_bucket_mask_ != sub_bucket_mask_)
+    {
+      return;
+    }
+
+    for (size_t i = 0; i < counts_.size(); ++i)
+    {
+      counts_[i] += other.counts_[i];
+    }
+    total_count_ += other.total_count_;
+    total_value_ += other.total_value_;
+    min_ = (std::min)(min_, other.min_);
+    max_ = (std::max)(max_, other.max_);
+  }
+
+  void reset()
+  {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    total_count_ = 0;
+    total_value_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+  }
+
+public:
+  std::uint64_t count() const
+  {
+    return total_count_;
+  }
+
+  std::uint64_t min() const
+  {
+    return total_count_ ? min_ : 0;
+  }
+
+  std::uint64_t max() const
+  {
+    return max_;
+  }
+
+  double mean() const
+  {
+    return total_count_ ? total_value_ / total_count_ : 0;
+  }
+
+  // return: the value at or below which percent (0 - 100) of the recorded values are, within the
+  // precision of the histogram.
+  std::uint64_t percentile(double percent) const
+  {
+    if (!total_count_)
+    {
+      return 0;
+    }
+
+    percent = (std::min)((std::max)(percent, 0.0), 100.0);
+    auto target = static_cast<std::uint64_t>(std::ceil(percent / 100 * total_count_));
+    target = (std::max)(target, std::uint64_t(1));
+
+    std::uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); ++i)
+    {
+      seen += counts_[i];
+      if (seen >= target)
+      {
+        return (std::min)(highest_equivalent(i), max_);
+      }
+    }
+    return max_;
+  }
+
+private:
+  size_t index_of(std::uint64_t value) const
+  {
+    // the power of 2 of value, at least the one of the sub buckets.
+    auto magnitude = static_cast<int>(boost::core::bit_width(value | sub_bucket_mask_)) - 1;
+
+    auto bucket = magnitude - sub_bucket_magnitude_ + 1;
+    auto sub_bucket = value >> bucket;
+
+    // every bucket but the first only uses its upper half, the lower half is in the previous one.
+    return (static_cast<size_t>(bucket + 1) << sub_bucket_half_magnitude_) + sub_bucket -
+           (std::uint64_t(1) << sub_bucket_half_magnitude_);
+  }
+
+  // the largest value counted at index.
+  std::uint64_t highest_equivalent(size_t index) const
+  {
+    auto bucket = static_cast<int>(index >> sub_bucket_half_magnitude_) - 1;
+    auto sub_bucket = (index & ((size_t(1) << sub_bucket_half_magnitude_) - 1)) +
+                      (size_t(1) << sub_bucket_half_magnitude_);
+    if (bucket < 0)
+    {
+      sub_bucket -= size_t(1) << sub_bucket_half_magnitude_;
+      bucket = 0;
+    }
+
+    return (static_cast<std::uint64_t>(sub_bucket) << bucket) + (std::uint64_t(1) << bucket) - 1;
+  }
+
+private:
+  std::uint64_t              highest_value_;
+  int                        sub_bucket_magnitude_{ 0 };
+  int                        sub_bucket_half_magnitude_{ 0 };
+  std::uint64_t              sub_bucket_mask_{ 0 };
+  std::vector<std::uint64_t> counts_;
+  std::uint64_t              total_count_{ 0 };
+  double                     total_value_{ 0 };
+  std::uint64_t              min_{ UINT64_MAX };
+  std::uint64_t              max_{ 0 };
+};
+
+} // namespace nly
+
+#endif // NLY_LATENCY_HISTOGRAM
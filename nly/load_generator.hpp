@@ -0,0 +1,385 @@
+#ifndef NLY_LOAD_GENERATOR
+#define NLY_LOAD_GENERATOR
+
+#include "nly/network.hpp"
+#include "nly/latency_histogram.hpp"
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <optional>
+#include <functional>
+#include <string_view>
+
+namespace nly
+{
+
+// What load_generator sends.
+struct load_generator_options
+{
+  // http://host[:port][/target], https isn't supported.
+  std::string url;
+
+  beast_http::verb method{ beast_http::verb::get };
+  std::string      body;
+
+  // every connection sends its requests one after the other.
+  size_t connection_count{ 1 };
+
+  // The requests per second over every connection, each connection sends at its share of it.
+  // 0 runs closed-loop: a connection sends the next request as soon as it has the response.
+  double rate{ 0 };
+
+  std::chrono::milliseconds duration{ 10000 };
+
+  // a request without a response within it counts as an error and its connection is reopened.
+  std::chrono::milliseconds timeout{ 5000 };
+
+  // set on every connection.
+  socket_options socket;
+
+  // Closed-loop only, the interval the requests are expected at. A response slower than it is
+  // also recorded as the requests which would have been sent meanwhile. 0 uses the mean latency
+  // of every connection, measured over the run.
+  std::chrono::microseconds expected_interval{ 0 };
+
+  // A connection which can't be reopened is tried again after this delay, doubled on every failure
+  // up to max_reconnect_delay.
+  std::chrono::milliseconds reconnect_delay{ 10 };
+  std::chrono::milliseconds max_reconnect_delay{ 1000 };
+};
+
+// What load_generator measured, the latencies are in microseconds.
+struct load_generator_result
+{
+  load_generator_options options;
+
+  size_t request_count{ 0 };
+  size_t error_count{ 0 };
+  size_t non_2xx_count{ 0 };
+
+  // unit: second
+  double elapsed{ 0 };
+
+  // At a fixed rate a latency runs from the time the request should have been sent, so a stalled
+  // server is charged for the requests queued behind it (coordinated omission). In closed-loop
+  // it is corrected with expected_interval.
+  latency_histogram latency;
+
+  // The interval the requests were expected at: the one of a connection at a fixed rate, else
+  // expected_interval or the mean latency it defaulted to. unit: microsecond
+  double expected_interval{ 0 };
+
+  // from the time every request was actually sent.
+  latency_histogram uncorrected_latency;
+
+public:
+  // responses per second.
+  double throughput() const
+  {
+    return elapsed > 0 ? request_count / elapsed : 0;
+  }
+
+  std::string to_json() const
+  {
+    std::string result = "{\n";
+    result += "  \"url\": \"" + escape(options.url) + "\",\n";
+    result += "  \"method\": \"" + std::string(beast_http::to_string(options.method)) + "\",\n";
+    result += "  \"connections\": " + std::to_string(options.connection_count) + ",\n";
+    result += "  \"rate\": " + number(options.rate) + ",\n";
+    result += "  \"duration_ms\": " + std::to_string(options.duration.count()) + ",\n";
+    result += "  \"elapsed_s\": " + number(elapsed) + ",\n";
+    result += "  \"requests\": " + std::to_string(request_count) + ",\n";
+    result += "  \"errors\": " + std::to_string(error_count) + ",\n";
+    result += "  \"non_2xx\": " + std::to_string(non_2xx_count) + ",\n";
+    result += "  \"throughput\": " + number(throughput()) + ",\n";
+    result += "  \"expected_interval_us\": " + number(expected_interval) + ",\n";
+    result += "  \"latency_us\": " + summary(latency) + ",\n";
+    result += "  \"uncorrected_latency_us\": " + summary(uncorrected_latency) + "\n";
+    result += "}\n";
+    return result;
+  }
+
+private:
+  static std::string summary(const latency_histogram& histogram)
+  {
+    return "{ \"count\": " + std::to_string(histogram.count()) +
+           ", \"min\": " + std::to_string(histogram.min()) + ", \"mean\": " +
+           number(histogram.mean()) + ", \"p50\": " + std::to_string(histogram.percentile(50)) +
+           ", \"p90\": " + std::to_string(histogram.percentile(90)) +
+           ", \"p99\": " + std::to_string(histogram.percentile(99)) +
+           ", \"p999\": " + std::to_string(histogram.percentile(99.9)) +
+           ", \"max\": " + std::to_string(histogram.max()) + " }";
+  }
+
+  static std::string number(double value)
+  {
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+    return buffer;
+  }
+
+  static std::string escape(const std::string& value)
+  {
+    std::string result;
+    for (auto c : value)
+    {
+      if (c == '"' || c == '\\')
+      {
+        result += '\\';
+        result += c;
+      }
+      else if (static_cast<unsigned char>(c) < 0x20)
+      {
+        char buffer[8];
+        std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+        result += buffer;
+      }
+      else
+      {
+        result += c;
+      }
+    }
+    return result;
+  }
+};
+
+// Drives keep-alive connections to a url with http_client, one thread per connection, and records
+// the latency of every response, like wrk2.
+// Note: The load generator shares the cores with the server on a local run, use fewer
+// connections than cores to measure the server.
+class load_generator
+{
+public:
+  typedef load_generator_options options;
+  typedef load_generator_result  result;
+
+  // The parts of an http url.
+  struct url_type
+  {
+    std::string host;
+    std::string service;
+    std::string target;
+  };
+
+public:
+  explicit load_generator(const options& opt)
+    : options_(opt)
+  {
+  }
+
+public:
+  // Connects every connection, then sends requests for the duration.
+  // return: empty if the url is invalid or a connection can't be opened.
+  std::optional<result> run(const std::function<bool()>& early_terminate = nullptr) const
+  {
+    auto url = parse_url(options_.url);
+    if (!url || !options_.connection_count)
+    {
+      return {};
+    }
+
+    auto endpoints = http_client::resolve(url->host, url->service, options_.timeout);
+    if (endpoints.empty())
+    {
+      return {};
+    }
+
+    std::vector<std::unique_ptr<http_client>> clients;
+    for (size_t i = 0; i < options_.connection_count; ++i)
+    {
+      clients.emplace_back(std::make_unique<http_client>());
+      clients.back()->set_socket_options(options_.socket);
+      if (!clients.back()->set_host(endpoints) || !clients.back()->connect(options_.timeout))
+      {
+        return {};
+      }
+    }
+
+    auto req = make_request_msg(options_.method, url->target, options_.body);
+    req.set(beast_http::field::host, url->host);
+
+    std::vector<result>      results(clients.size());
+    std::vector<std::thread> threads;
+    auto                     start_time = nly::now();
+    for (size_t i = 0; i < clients.size(); ++i)
+    {
+      threads.emplace_back(
+        [&, i]()
+        {
+          drive(*clients[i], req, start_time, i, results[i], early_terminate);
+        });
+    }
+
+    for (auto& item : threads)
+    {
+      item.join();
+    }
+
+    result total;
+    total.options = options_;
+    total.elapsed = nly::time_diff(start_time);
+    for (auto& item : results)
+    {
+      // a closed-loop connection sends its next request as soon as it has a response.
+      if (options_.rate <= 0 && !options_.expected_interval.count())
+      {
+        auto mean = static_cast<std::uint64_t>(item.uncorrected_latency.mean());
+        item.latency = item.uncorrected_latency.corrected(mean);
+        item.expected_interval = static_cast<double>(mean);
+      }
+
+      total.request_count += item.request_count;
+      total.error_count += item.error_count;
+      total.non_2xx_count += item.non_2xx_count;
+      total.latency.merge(item.latency);
+      total.uncorrected_latency.merge(item.uncorrected_latency);
+      total.expected_interval += item.expected_interval * item.request_count;
+    }
+    if (total.request_count)
+    {
+      total.expected_interval /= total.request_count;
+    }
+    return total;
+  }
+
+  // return: empty if url isn't a valid http url.
+  static std::optional<url_type> parse_url(std::string_view url)
+  {
+    static constexpr std::string_view scheme = "http://";
+    if (url.substr(0, scheme.size()) != scheme)
+    {
+      return {};
+    }
+    url.remove_prefix(scheme.size());
+
+    auto slash = url.find('/');
+    auto authority = url.substr(0, slash);
+    auto target = slash == std::string_view::npos ? std::string_view("/") : url.substr(slash);
+
+    // [v6 address]:port
+    auto colon = authority.rfind(':');
+    if (colon != std::string_view::npos && authority.find(']', colon) != std::string_view::npos)
+    {
+      colon = std::string_view::npos;
+    }
+
+    url_type result;
+    result.host = std::string(authority.substr(0, colon));
+    result.service =
+      colon == std::string_view::npos ? "http" : std::string(authority.substr(colon + 1));
+    result.target = std::string(target);
+    if (result.host.size() > 1 && result.host.front() == '[' && result.host.back() == ']')
+    {
+      result.host = result.host.substr(1, result.host.size() - 2);
+    }
+
+    if (result.host.empty() || result.service.empty())
+    {
+      return {};
+    }
+    return result;
+  }
+
+private:
+  // sends the requests of connection index until the duration is over.
+  void drive(
+    http_client&                                        client,
+    const beast_http::request<beast_http::string_body>& req,
+    nly::time_point                                     start_time,
+    size_t                                              index,
+    result&                                             out,
+    const std::function<bool()>&                        early_terminate) const
+  {
+    const auto end_time = start_time + options_.duration;
+    const auto expected_interval = static_cast<std::uint64_t>(options_.expected_interval.count());
+
+    // at a fixed rate the connections are staggered over the interval of a connection.
+    std::chrono::nanoseconds interval{ 0 };
+    if (options_.rate > 0)
+    {
+      interval = std::chrono::nanoseconds(
+        static_cast<long long>(1e9 * options_.connection_count / options_.rate));
+    }
+    auto next = start_time + interval * index / options_.connection_count;
+    out.expected_interval =
+      interval.count() ? interval.count() / 1000.0 : static_cast<double>(expected_interval);
+
+    beast_http::response<beast_http::string_body> rep;
+    auto                                          reconnect_delay = options_.reconnect_delay;
+    while (true)
+    {
+      auto intended = nly::now();
+      if (interval.count())
+      {
+        if (next >= end_time)
+        {
+          break;
+        }
+
+        std::this_thread::sleep_until(next);
+        intended = next;
+        next += interval;
+      }
+      else if (intended >= end_time)
+      {
+        break;
+      }
+
+      if (early_terminate && early_terminate())
+      {
+        break;
+      }
+
+      if (!client.is_connected())
+      {
+        if (!client.connect(options_.timeout))
+        {
+          ++out.error_count;
+          std::this_thread::sleep_until((std::min)(nly::now() + reconnect_delay, end_time));
+          reconnect_delay = (std::min)(reconnect_delay * 2, options_.max_reconnect_delay);
+          continue;
+        }
+        reconnect_delay = options_.reconnect_delay;
+      }
+
+      auto sent = nly::now();
+      if (!client.deal_command(req, rep, options_.timeout))
+      {
+        ++out.error_count;
+        client.close();
+        continue;
+      }
+      auto done = nly::now();
+
+      ++out.request_count;
+      if (rep.result_int() / 100 != 2)
+      {
+        ++out.non_2xx_count;
+      }
+      if (!rep.keep_alive())
+      {
+        client.close();
+      }
+
+      auto latency = static_cast<std::uint64_t>(nly::time_diff_us(sent, done));
+      out.uncorrected_latency.record(latency);
+      if (interval.count())
+      {
+        out.latency.record(static_cast<std::uint64_t>(nly::time_diff_us(intended, done)));
+      }
+      else if (expected_interval)
+      {
+        out.latency.record_corrected(latency, expected_interval);
+      }
+    }
+  }
+
+private:
+  options options_;
+};
+
+} // namespace nly
+
+#endif // NLY_LOAD_GENERATOR
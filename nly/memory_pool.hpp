@@ -2,10 +2,216 @@
 #define NLY_MEMORY_POOL
 #include "boost/pool/pool.hpp"
 #include "boost/signals2/dummy_mutex.hpp"
+#include "nly/time/time_count.hpp"
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+#include <unordered_map>
 
 namespace nly
 {
-template<typename t_mutex = boost::signals2::dummy_mutex>
+
+// Statistics of a memory_pool, see memory_pool::snapshot.
+struct memory_pool_stats
+{
+  // nodes currently allocated and the highest value it reached.
+  size_t live_node{ 0 };
+  size_t peak_node{ 0 };
+
+  // bytes currently requested from the system and the number of times the pool grew.
+  size_t reserved_byte{ 0 };
+  size_t growth_count{ 0 };
+
+  // total time spent waiting for the lock of the pool, unit: nanosecond.
+  unsigned long long lock_wait_ns{ 0 };
+
+  // malloc_latency[i] counts the mallocs that took [2^i, 2^(i+1)) nanoseconds, including the lock
+  // wait, the last bucket also counts everything slower.
+  size_t malloc_latency[32]{};
+
+  // bytes returned to the system by trim, see memory_pool::trim.
+  size_t trimmed_byte{ 0 };
+};
+
+namespace detail
+{
+// boost::pool with access to its block list and free list.
+template<typename t_user_allocator>
+class open_pool : public boost::pool<t_user_allocator>
+{
+  typedef boost::pool<t_user_allocator>                              base_type;
+  typedef boost::details::PODptr<typename t_user_allocator::size_type> block_ptr;
+
+public:
+  using base_type::pool;
+
+  struct block_range
+  {
+    char*  begin;
+    size_t node_count;
+    size_t total_byte;
+  };
+
+  bool free_list_empty() const
+  {
+    return this->empty();
+  }
+
+  size_t free_list_length() const
+  {
+    size_t result = 0;
+    for (auto p = this->first; p; p = next_of(p))
+    {
+      ++result;
+    }
+    return result;
+  }
+
+  size_t reserved_byte() const
+  {
+    size_t result = 0;
+    for (auto block = this->list; block.valid(); block = block.next())
+    {
+      result += block.total_size();
+    }
+    return result;
+  }
+
+  // the number of nodes in every block.
+  size_t capacity_node() const
+  {
+    size_t result = 0;
+    for (auto block = this->list; block.valid(); block = block.next())
+    {
+      result += block.element_size() / this->alloc_size();
+    }
+    return result;
+  }
+
+  // the distance between two nodes of a block.
+  size_t node_byte() const
+  {
+    return this->alloc_size();
+  }
+
+  void blocks(std::vector<block_range>& out) const
+  {
+    for (auto block = this->list; block.valid(); block = block.next())
+    {
+      out.push_back(
+        { block.begin(), block.element_size() / this->alloc_size(), block.total_size() });
+    }
+  }
+
+  // takes up to count nodes off the front of the free list into out.
+  void pop_free_list(size_t count, std::vector<char*>& out)
+  {
+    for (; count && this->first; --count)
+    {
+      out.emplace_back(static_cast<char*>(this->first));
+      this->first = next_of(this->first);
+    }
+  }
+
+  // puts the nodes from first to last in front of the free list, in their order.
+  template<typename t_iterator>
+  void push_free_list(t_iterator first, t_iterator last)
+  {
+    if (first == last)
+    {
+      return;
+    }
+
+    void* head = *first;
+    void* tail = head;
+    for (++first; first != last; ++first)
+    {
+      next_of(tail) = *first;
+      tail = *first;
+    }
+    next_of(tail) = this->first;
+    this->first = head;
+  }
+
+  // removes the blocks beginning at begins from the block list, begins must be sorted and none of
+  // the nodes of the blocks may be allocated or in the free list.
+  void unlink_blocks(const std::vector<char*>& begins)
+  {
+    if (begins.empty())
+    {
+      return;
+    }
+
+    block_ptr prev;
+    for (auto block = this->list; block.valid();)
+    {
+      auto next = block.next();
+      if (!std::binary_search(begins.begin(), begins.end(), block.begin(), std::less<char*>()))
+      {
+        prev = block;
+      }
+      else if (prev.valid())
+      {
+        prev.next(next);
+      }
+      else
+      {
+        this->list = next;
+      }
+      block = next;
+    }
+
+    // grow from the initial size again, like release_memory.
+    this->next_size = this->start_size;
+  }
+
+  static void*& next_of(void* p)
+  {
+    return base_type::nextof(p);
+  }
+};
+
+struct no_stats
+{
+};
+} // namespace detail
+
+// Automatic trimming of the free memory of a memory_pool, see memory_pool::set_trim_policy.
+// Free memory is kept in whole blocks, only blocks without allocated nodes can be returned, so the
+// free memory may stay above the watermarks when it is fragmented.
+struct trim_policy
+{
+  // free memory kept for future mallocs, unit: byte.
+  size_t low_watermark{ 0 };
+
+  // when free exceeds it, the next trim_step trims the free memory down to low_watermark at once,
+  // whatever decay_time, a value of 0 disables it, unit: byte.
+  size_t high_watermark{ 0 };
+
+  // Called by the free crossing high_watermark, for example to wake up nly::pool_trimmer. It runs
+  // under the lock of the pool, so it must be short and must not use the pool.
+  std::function<void()> on_high_watermark;
+
+  // free memory above low_watermark is returned gradually by trim_step: a step returns the share
+  // of it given by the time since the previous step over decay_time, a value of 0 returns all of
+  // it at once.
+  std::chrono::milliseconds decay_time{ 10000 };
+};
+
+// t_stats: whether to collect memory_pool_stats, with it false and no trim policy the nodes are not
+// even counted.
+// t_user_allocator: where the memory blocks come from, see boost::pool and nly/page_allocator.hpp.
+template<
+  typename t_mutex = boost::signals2::dummy_mutex,
+  bool     t_stats = false,
+  typename t_user_allocator = boost::default_user_allocator_new_delete>
 class memory_pool
 {
 public:
@@ -31,47 +237,677 @@ public:
   // returns 0 if out-of-memory.
   void* malloc()
   {
-    std::lock_guard<t_mutex> guard(this->mutex_);
-    return pool_.malloc();
+    if constexpr (t_stats)
+    {
+      auto start_time = nly::now();
+      auto guard = this->lock();
+      auto p = this->node_malloc();
+      record_latency(std::chrono::duration_cast<std::chrono::nanoseconds>(nly::now() - start_time));
+      return p;
+    }
+    else
+    {
+      auto guard = this->lock();
+      return this->node_malloc();
+    }
   }
 
   void free(void* p)
   {
-    std::lock_guard<t_mutex> guard(this->mutex_);
-    return pool_.free(p);
+    auto guard = this->lock();
+    pool_.free(p);
+    if (this->counting())
+    {
+      --live_node_;
+      this->check_high_watermark();
+    }
+  }
+
+  // allocates count nodes into out with a single lock.
+  // return: the number of nodes allocated, less than count only if out-of-memory.
+  size_t malloc_n(size_t count, void** out)
+  {
+    auto guard = this->lock();
+    for (size_t i = 0; i < count; ++i)
+    {
+      out[i] = this->node_malloc();
+      if (!out[i])
+      {
+        return i;
+      }
+    }
+    return count;
+  }
+
+  // frees count nodes with a single lock.
+  void free_n(void* const* ptrs, size_t count)
+  {
+    auto guard = this->lock();
+    for (size_t i = 0; i < count; ++i)
+    {
+      pool_.free(ptrs[i]);
+    }
+    if (this->counting())
+    {
+      live_node_ -= count;
+      this->check_high_watermark();
+    }
+  }
+
+  // makes sure at least count nodes can be allocated without requesting memory from the system.
+  // return: false if out-of-memory.
+  // Note: Call it before a latency-critical phase, so the doubling growth doesn't happen there.
+  bool reserve(size_t count)
+  {
+    if (!count)
+    {
+      return true;
+    }
+
+    auto guard = this->lock();
+
+    // ordered_malloc only requests memory if there are not count contiguous free nodes.
+    auto p = pool_.ordered_malloc(count);
+    if (!p)
+    {
+      return false;
+    }
+    pool_.free(p, count);
+    if (this->counting())
+    {
+      capacity_node_ = pool_.capacity_node();
+    }
+
+    if constexpr (t_stats)
+    {
+      auto reserved_byte = pool_.reserved_byte();
+      if (reserved_byte != stats_.reserved_byte)
+      {
+        stats_.reserved_byte = reserved_byte;
+        ++stats_.growth_count;
+      }
+    }
+    return true;
   }
 
   // frees every memory block that doesn't have any allocated chunks.
   // return: true if at least one memory block was freed.
   bool release_unused()
   {
-    std::lock_guard<t_mutex> guard(this->mutex_);
-    return pool_.release_memory();
+    return trim(0) > 0;
   }
 
   // frees every memory block.
   // true if at least one memory block was freed.
   bool release_all()
   {
-    std::lock_guard<t_mutex> guard(this->mutex_);
+    auto guard = this->lock();
+    live_node_ = 0;
+    capacity_node_ = 0;
+    ++purge_count_;
+    if constexpr (t_stats)
+    {
+      stats_.reserved_byte = 0;
+    }
     return pool_.purge_memory();
   }
 
+  // Returns the blocks whose nodes are all free to the system, keeping at least keep_node free
+  // nodes.
+  // return: the number of bytes returned.
+  // Note: The lock is taken for at most trim_batch_node nodes at a time, the free nodes are taken
+  // off the free list and matched to their blocks without it. The mallocs meanwhile see a shorter
+  // free list.
+  size_t trim(size_t keep_node)
+  {
+    typedef typename decltype(pool_)::block_range block_range;
+
+    std::vector<char*>       nodes;
+    std::vector<block_range> blocks;
+    size_t                   purge_count = 0;
+    size_t                   target = SIZE_MAX;
+    size_t                   node_byte = 0;
+    {
+      auto guard = this->lock();
+      if (this->counting())
+      {
+        if (capacity_node_ - live_node_ <= keep_node)
+        {
+          return 0;
+        }
+        target = capacity_node_ - live_node_ - keep_node;
+        keep_node = 0;
+      }
+      purge_count = purge_count_;
+      node_byte = pool_.node_byte();
+    }
+
+    // takes the free nodes off the free list, the last batch also copies the block list.
+    while (true)
+    {
+      auto guard = this->lock();
+      if (purge_count != purge_count_)
+      {
+        // release_all freed them.
+        return 0;
+      }
+
+      pool_.pop_free_list((std::min)(trim_batch_node, target - nodes.size()), nodes);
+      if (nodes.size() == target || pool_.free_list_empty())
+      {
+        pool_.blocks(blocks);
+        break;
+      }
+    }
+
+    // sorted by address, the nodes of a block are contiguous. Only the addresses are used here,
+    // the nodes aren't touched until the lock is taken again.
+    std::sort(nodes.begin(), nodes.end(), std::less<char*>());
+    std::sort(
+      blocks.begin(),
+      blocks.end(),
+      [](const block_range& a, const block_range& b)
+      { return std::less<char*>()(a.begin, b.begin); });
+
+    std::vector<block_range> full;
+    auto                     iter = nodes.begin();
+    for (auto& block : blocks)
+    {
+      auto first = std::lower_bound(iter, nodes.end(), block.begin, std::less<char*>());
+      auto last = std::lower_bound(
+        first, nodes.end(), block.begin + block.node_count * node_byte, std::less<char*>());
+      if (static_cast<size_t>(last - first) == block.node_count)
+      {
+        full.push_back(block);
+      }
+      iter = last;
+    }
+
+    // without the counts, keep_node is kept from the nodes taken.
+    auto kept_node = nodes.size();
+    for (auto& block : full)
+    {
+      kept_node -= block.node_count;
+    }
+    while (!full.empty() && kept_node < keep_node)
+    {
+      kept_node += full.back().node_count;
+      full.pop_back();
+    }
+
+    std::vector<char*> released;
+    std::vector<char*> kept;
+    size_t             released_node = 0;
+    size_t             released_byte = 0;
+    iter = nodes.begin();
+    for (auto& block : full)
+    {
+      auto first = std::lower_bound(iter, nodes.end(), block.begin, std::less<char*>());
+      kept.insert(kept.end(), iter, first);
+      iter = first + block.node_count;
+      released.emplace_back(block.begin);
+      released_node += block.node_count;
+      released_byte += block.total_byte;
+    }
+    kept.insert(kept.end(), iter, nodes.end());
+
+    // the nodes left go back to the free list in address order, a batch per lock.
+    for (size_t i = 0; i == 0 || i < kept.size(); i += trim_batch_node)
+    {
+      auto guard = this->lock();
+      if (purge_count != purge_count_)
+      {
+        return 0;
+      }
+
+      if (i == 0 && !released.empty())
+      {
+        pool_.unlink_blocks(released);
+        if (this->counting())
+        {
+          capacity_node_ -= released_node;
+        }
+
+        if constexpr (t_stats)
+        {
+          stats_.reserved_byte = pool_.reserved_byte();
+          stats_.trimmed_byte += released_byte;
+        }
+      }
+
+      // pushed from the end, so the whole list ends up in address order.
+      auto last = kept.size() - i;
+      auto first = last - (std::min)(trim_batch_node, last);
+      pool_.push_free_list(kept.begin() + first, kept.begin() + last);
+    }
+
+    for (auto p : released)
+    {
+      (t_user_allocator::free)(p);
+    }
+    return released_byte;
+  }
+
+  // enables automatic trimming, see trim_policy.
+  void set_trim_policy(const trim_policy& policy)
+  {
+    auto guard = this->lock();
+    auto node_byte = pool_.node_byte();
+
+    // the nodes are only counted from now on.
+    if (!this->counting())
+    {
+      capacity_node_ = pool_.capacity_node();
+      live_node_ = capacity_node_ - pool_.free_list_length();
+    }
+
+    trim_low_node_ = policy.low_watermark / node_byte;
+    trim_high_node_ = policy.high_watermark ? policy.high_watermark / node_byte : SIZE_MAX;
+    trim_high_node_ = (std::max)(trim_high_node_, trim_low_node_);
+    trim_next_node_ = trim_high_node_;
+    decay_time_ = policy.decay_time;
+    on_high_watermark_ = policy.on_high_watermark;
+    last_step_time_ = nly::now();
+    trim_requested_ = false;
+    trim_enabled_ = true;
+  }
+
+  // returns part of the free memory above the low watermark to the system, see
+  // trim_policy::decay_time, or all of it if the high watermark was crossed. Call it periodically,
+  // for example with nly::pool_trimmer.
+  // return: the number of bytes returned, 0 if set_trim_policy was not called.
+  size_t trim_step()
+  {
+    size_t keep_node = 0;
+    bool   requested = false;
+    {
+      auto guard = this->lock();
+      if (!trim_enabled_)
+      {
+        return 0;
+      }
+
+      auto now = nly::now();
+      auto elapsed = now - last_step_time_;
+      last_step_time_ = now;
+      requested = trim_requested_;
+      trim_requested_ = false;
+
+      auto free_node = capacity_node_ - live_node_;
+      if (free_node <= trim_low_node_)
+      {
+        this->rearm_high_watermark(requested);
+        return 0;
+      }
+
+      auto excess = free_node - trim_low_node_;
+      if (!requested && decay_time_.count() > 0 && elapsed < decay_time_)
+      {
+        excess = static_cast<size_t>(
+          excess * std::chrono::duration<double>(elapsed) /
+          std::chrono::duration<double>(decay_time_));
+      }
+
+      if (!excess)
+      {
+        return 0;
+      }
+      keep_node = free_node - excess;
+    }
+
+    auto result = trim(keep_node);
+
+    auto guard = this->lock();
+    this->rearm_high_watermark(requested);
+    return result;
+  }
+
+  // the number of nodes that can be allocated without requesting memory from the system.
+  size_t free_node()
+  {
+    auto guard = this->lock();
+    return this->counting() ? capacity_node_ - live_node_ : pool_.free_list_length();
+  }
+
   // the size of a single memory block requested.
   size_t node_size()
   {
-    std::lock_guard<t_mutex> guard(this->mutex_);
+    auto guard = this->lock();
     return pool_.get_requested_size();
   }
 
+  // a copy of the statistics, t_stats must be true.
+  memory_pool_stats snapshot()
+  {
+    static_assert(t_stats, "memory_pool_stats are only collected if t_stats is true");
+    auto guard = this->lock();
+    auto result = stats_;
+    result.live_node = live_node_;
+    return result;
+  }
+
 private:
-  boost::pool<> pool_;
-  t_mutex       mutex_;
-};
+  std::lock_guard<t_mutex> lock()
+  {
+    if constexpr (t_stats)
+    {
+      auto start_time = nly::now();
+      mutex_.lock();
+      stats_.lock_wait_ns +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(nly::now() - start_time).count();
+      return std::lock_guard<t_mutex>(mutex_, std::adopt_lock);
+    }
+    else
+    {
+      return std::lock_guard<t_mutex>(mutex_);
+    }
+  }
+
+  // Whether live_node_ and capacity_node_ are kept, they are only needed by the statistics and
+  // the trim policy.
+  bool counting() const
+  {
+    if constexpr (t_stats)
+    {
+      return true;
+    }
+    else
+    {
+      return trim_enabled_;
+    }
+  }
+
+  // the lock must be held.
+  void* node_malloc()
+  {
+    if (!this->counting())
+    {
+      return pool_.malloc();
+    }
+
+    auto growth = pool_.free_list_empty();
+    auto p = pool_.malloc();
+    if (!p)
+    {
+      return p;
+    }
+
+    ++live_node_;
+    if (growth)
+    {
+      capacity_node_ = pool_.capacity_node();
+    }
+
+    if constexpr (t_stats)
+    {
+      if (growth)
+      {
+        ++stats_.growth_count;
+        stats_.reserved_byte = pool_.reserved_byte();
+      }
+
+      stats_.peak_node = (std::max)(stats_.peak_node, live_node_);
+    }
+    return p;
+  }
+
+  // the lock must be held. Requests a full trim_step when the free nodes cross the high
+  // watermark, the freeing thread doesn't trim.
+  void check_high_watermark()
+  {
+    if (capacity_node_ - live_node_ <= trim_next_node_)
+    {
+      return;
+    }
+
+    // the other frees don't request it again until the step is done.
+    trim_next_node_ = SIZE_MAX;
+    trim_requested_ = true;
+    if (on_high_watermark_)
+    {
+      on_high_watermark_();
+    }
+  }
+
+  // the lock must be held. After a requested step, if fragmentation kept the free memory high,
+  // request another only after as many frees as it takes to climb from the low watermark to the
+  // high one.
+  void rearm_high_watermark(bool requested)
+  {
+    if (requested)
+    {
+      trim_next_node_ = (std::max)(
+        trim_high_node_, capacity_node_ - live_node_ + trim_high_node_ - trim_low_node_);
+    }
+  }
+
+  // the lock must be held.
+  void record_latency(std::chrono::nanoseconds latency)
+  {
+    auto   value = latency.count();
+    size_t index = 0;
+    while (value > 1 && index + 1 < std::size(stats_.malloc_latency))
+    {
+      value >>= 1;
+      ++index;
+    }
+    ++stats_.malloc_latency[index];
+  }
+
+private:
+  // the most free nodes trim handles under a single lock.
+  static constexpr size_t trim_batch_node = 1024;
+
+private:
+  detail::open_pool<t_user_allocator> pool_;
+  t_mutex                             mutex_;
+
+  // incremented by release_all, a trim in progress gives up its nodes if it changed.
+  size_t purge_count_{ 0 };
 
+  // capacity_node_ - live_node_ is the length of the free list.
+  size_t live_node_{ 0 };
+  size_t capacity_node_{ 0 };
+
+  bool                      trim_enabled_{ false };
+  size_t                    trim_low_node_{ 0 };
+  size_t                    trim_high_node_{ SIZE_MAX };
+  size_t                    trim_next_node_{ SIZE_MAX };
+  std::chrono::milliseconds decay_time_{ 0 };
+  time_point                last_step_time_;
+  bool                      trim_requested_{ false };
+  std::function<void()>     on_high_watermark_;
+
+  std::conditional_t<t_stats, memory_pool_stats, detail::no_stats> stats_;
+};
 // thread safe memory pool.
 typedef memory_pool<std::mutex> memory_pool_s;
 
+// Thread safe memory pool with a per-thread cache of free nodes in front of the shared pool.
+// malloc and free only touch the cache of the calling thread, the shared pool is locked once per
+// batch_size nodes to refill or flush a cache.
+// Note: A node may be freed on any thread, it goes to the cache of the thread that frees it.
+class thread_cached_memory_pool
+{
+public:
+  /**
+   * @param batch_size The number of nodes moved between a thread cache and the shared pool at a
+   * time, a thread cache holds at most batch_size * 2 nodes.
+   *
+   * @param node_size, next_size, max_size See memory_pool.
+   */
+  thread_cached_memory_pool(
+    size_t node_size,
+    size_t batch_size = 32,
+    size_t next_size = 32,
+    size_t max_size = 0)
+    : shared_(std::make_shared<shared_type>(node_size, next_size, max_size))
+    , id_(next_id())
+    , batch_size_(batch_size ? batch_size : 1)
+  {
+  }
+
+  thread_cached_memory_pool(const thread_cached_memory_pool&) = delete;
+  thread_cached_memory_pool& operator=(const thread_cached_memory_pool&) = delete;
+
+public:
+  // returns 0 if out-of-memory.
+  void* malloc()
+  {
+    auto& cache = local_cache();
+    if (cache.nodes.empty())
+    {
+      cache.nodes.resize(batch_size_);
+      cache.nodes.resize(shared_->malloc_n(batch_size_, cache.nodes.data()));
+
+      if (cache.nodes.empty())
+      {
+        return nullptr;
+      }
+    }
+
+    auto p = cache.nodes.back();
+    cache.nodes.pop_back();
+    return p;
+  }
+
+  void free(void* p)
+  {
+    auto& cache = local_cache();
+    cache.nodes.emplace_back(p);
+
+    if (cache.nodes.size() >= batch_size_ * 2)
+    {
+      flush(cache, batch_size_);
+    }
+  }
+
+  // returns the nodes cached by the calling thread to the shared pool.
+  void flush()
+  {
+    auto& cache = local_cache();
+    flush(cache, cache.nodes.size());
+  }
+
+  // flushes the cache of the calling thread, then frees every memory block that doesn't have any
+  // allocated chunks.
+  // return: true if at least one memory block was freed.
+  // Note: Nodes cached by other threads still count as allocated.
+  bool release_unused()
+  {
+    flush();
+    return shared_->release_unused();
+  }
+
+  // makes sure at least count nodes can be allocated from the shared pool without requesting
+  // memory from the system.
+  bool reserve(size_t count)
+  {
+    return shared_->reserve(count);
+  }
+
+  // see memory_pool::set_trim_policy, the watermarks apply to the shared pool.
+  void set_trim_policy(const trim_policy& policy)
+  {
+    shared_->set_trim_policy(policy);
+  }
+
+  // see memory_pool::trim_step.
+  size_t trim_step()
+  {
+    return shared_->trim_step();
+  }
+
+  // the size of a single memory block requested.
+  size_t node_size()
+  {
+    return shared_->node_size();
+  }
+
+private:
+  typedef memory_pool_s shared_type;
+
+  struct cache_type
+  {
+    // expires when the pool is destroyed, the cached nodes are dropped with it.
+    std::weak_ptr<shared_type> owner;
+    std::vector<void*>         nodes;
+  };
+
+  // the caches of every pool used by a thread, returned to their pools when the thread exits.
+  struct thread_cache_type
+  {
+    ~thread_cache_type()
+    {
+      for (auto& item : caches)
+      {
+        flush(item.second, item.second.nodes.size());
+      }
+    }
+
+    std::unordered_map<size_t, cache_type> caches;
+
+    size_t      last_id{ 0 };
+    cache_type* last_cache{ nullptr };
+  };
+
+  static size_t next_id()
+  {
+    static std::atomic<size_t> id{ 0 };
+    return ++id;
+  }
+
+  static thread_cache_type& thread_cache()
+  {
+    thread_local thread_cache_type cache;
+    return cache;
+  }
+
+  static void flush(cache_type& cache, size_t count)
+  {
+    if (auto owner = cache.owner.lock())
+    {
+      owner->free_n(cache.nodes.data() + cache.nodes.size() - count, count);
+      cache.nodes.resize(cache.nodes.size() - count);
+    }
+    else
+    {
+      cache.nodes.clear();
+    }
+  }
+
+  cache_type& local_cache()
+  {
+    auto& thread_cache = thread_cached_memory_pool::thread_cache();
+    if (thread_cache.last_id == id_)
+    {
+      return *thread_cache.last_cache;
+    }
+
+    auto it = thread_cache.caches.find(id_);
+    if (it == thread_cache.caches.end())
+    {
+      // forget the caches of destroyed pools before adding a new one.
+      for (auto iter = thread_cache.caches.begin(); iter != thread_cache.caches.end();)
+      {
+        iter = iter->second.owner.expired() ? thread_cache.caches.erase(iter) : ++iter;
+      }
+
+      it = thread_cache.caches.emplace(id_, cache_type{ shared_, {} }).first;
+      it->second.nodes.reserve(batch_size_ * 2);
+    }
+
+    thread_cache.last_id = id_;
+    thread_cache.last_cache = &it->second;
+    return it->second;
+  }
+
+private:
+  std::shared_ptr<shared_type> shared_;
+  const size_t                 id_;
+  const size_t                 batch_size_;
+};
+
 } // namespace nly
 
 #endif
\ No newline at end of file
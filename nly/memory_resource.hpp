@@ -0,0 +1,206 @@
+#ifndef NLY_MEMORY_RESOURCE
+#define NLY_MEMORY_RESOURCE
+
+#include "nly/memory_pool.hpp"
+#include "nly/size_class_pool.hpp"
+#include <new>
+#include <cstddef>
+#include <memory_resource>
+
+namespace nly
+{
+
+// std::pmr::memory_resource backed by a fixed size pool, for example memory_pool or
+// thread_cached_memory_pool.
+// Requests larger than the node size of the pool or over-aligned requests go to upstream.
+// Note: The pool must outlive the resource.
+template<typename t_pool>
+class memory_pool_resource : public std::pmr::memory_resource
+{
+public:
+  memory_pool_resource(
+    t_pool&                     pool,
+    std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+    : pool_(pool)
+    , node_size_(pool.node_size())
+    , upstream_(upstream)
+  {
+  }
+
+  t_pool& pool() const
+  {
+    return pool_;
+  }
+
+  std::pmr::memory_resource* upstream() const
+  {
+    return upstream_;
+  }
+
+protected:
+  void* do_allocate(size_t bytes, size_t alignment) override
+  {
+    if (!from_pool(bytes, alignment))
+    {
+      return upstream_->allocate(bytes, alignment);
+    }
+
+    auto p = pool_.malloc();
+    if (!p)
+    {
+      throw std::bad_alloc();
+    }
+    return p;
+  }
+
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override
+  {
+    if (!from_pool(bytes, alignment))
+    {
+      return upstream_->deallocate(p, bytes, alignment);
+    }
+
+    pool_.free(p);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+  {
+    return this == &other;
+  }
+
+private:
+  bool from_pool(size_t bytes, size_t alignment) const
+  {
+    return bytes <= node_size_ && alignment <= alignof(std::max_align_t) &&
+           !(node_size_ % alignment);
+  }
+
+private:
+  t_pool&                    pool_;
+  const size_t               node_size_;
+  std::pmr::memory_resource* upstream_;
+};
+
+// std::pmr::memory_resource backed by a size_class_pool, over-aligned requests go to upstream.
+// Note: The pool must outlive the resource.
+template<typename t_mutex = boost::signals2::dummy_mutex>
+class size_class_resource : public std::pmr::memory_resource
+{
+public:
+  size_class_resource(
+    size_class_pool<t_mutex>&  pool,
+    std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+    : pool_(pool)
+    , upstream_(upstream)
+  {
+  }
+
+  size_class_pool<t_mutex>& pool() const
+  {
+    return pool_;
+  }
+
+  std::pmr::memory_resource* upstream() const
+  {
+    return upstream_;
+  }
+
+protected:
+  void* do_allocate(size_t bytes, size_t alignment) override
+  {
+    if (alignment > alignof(std::max_align_t))
+    {
+      return upstream_->allocate(bytes, alignment);
+    }
+
+    auto p = pool_.malloc(bytes);
+    if (!p)
+    {
+      throw std::bad_alloc();
+    }
+    return p;
+  }
+
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override
+  {
+    if (alignment > alignof(std::max_align_t))
+    {
+      return upstream_->deallocate(p, bytes, alignment);
+    }
+
+    pool_.free(p);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+  {
+    return this == &other;
+  }
+
+private:
+  size_class_pool<t_mutex>&  pool_;
+  std::pmr::memory_resource* upstream_;
+};
+
+// Classic allocator backed by a size_class_pool, for containers that don't take a
+// std::pmr::polymorphic_allocator.
+// Note: The pool must outlive every container using the allocator.
+template<typename T, typename t_pool = size_class_pool_s>
+class pool_allocator
+{
+  static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+
+public:
+  typedef T value_type;
+
+public:
+  pool_allocator(t_pool& pool) noexcept
+    : pool_(&pool)
+  {
+  }
+
+  template<typename U>
+  pool_allocator(const pool_allocator<U, t_pool>& other) noexcept
+    : pool_(&other.pool())
+  {
+  }
+
+public:
+  T* allocate(size_t n)
+  {
+    auto p = pool_->malloc(n * sizeof(T));
+    if (!p)
+    {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(p);
+  }
+
+  void deallocate(T* p, size_t)
+  {
+    pool_->free(p);
+  }
+
+  t_pool& pool() const
+  {
+    return *pool_;
+  }
+
+private:
+  t_pool* pool_;
+};
+
+template<typename T, typename U, typename t_pool>
+inline bool operator==(const pool_allocator<T, t_pool>& a, const pool_allocator<U, t_pool>& b)
+{
+  return &a.pool() == &b.pool();
+}
+
+template<typename T, typename U, typename t_pool>
+inline bool operator!=(const pool_allocator<T, t_pool>& a, const pool_allocator<U, t_pool>& b)
+{
+  return !(a == b);
+}
+
+} // namespace nly
+
+#endif // NLY_MEMORY_RESOURCE
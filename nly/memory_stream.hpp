@@ -1,10 +1,16 @@
 #ifndef NLY_MEMORY_STREAM
 #define NLY_MEMORY_STREAM
 
+#include "nly/memory_pool.hpp"
 #include <deque>
 #include <memory>
+#include <vector>
+#include <atomic>
+#include <future>
 #include <cassert>
+#include <cstring>
 #include <functional>
+#include <memory_resource>
 
 namespace nly
 {
@@ -71,8 +77,13 @@ public:
   typedef std::function<void(const memory_type&)> release_type;
 
 public:
-  memory_stream(release_type f)
+  // resource: where the chunk bookkeeping of the stream is allocated from.
+  memory_stream(
+    release_type               f,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource())
     : m_release(f)
+    , m_memory_chunk(resource)
+    , m_retained_chunk(resource)
   {
   }
 
@@ -81,20 +92,54 @@ public:
 
   ~memory_stream()
   {
-    if (m_release)
+    commit();
+
+    for (const auto& item : m_memory_chunk)
+    {
+      release_chunk(item);
+    }
+  }
+
+public:
+  // Chunks shorter than threshold bytes are copied into pooled blocks of block_byte bytes and
+  // released immediately in add, longer chunks are still referenced without copying.
+  // threshold: 0 disables coalescing.
+  // Return false if block_byte is changed while pooled blocks are still held by the stream.
+  bool set_coalesce(const size_t threshold, const size_t block_byte = 4096)
+  {
+    assert(threshold <= block_byte);
+
+    if (!m_block_pool || m_block_pool->node_size() != block_byte)
     {
-      for (const auto& item : m_memory_chunk)
+      if (m_pooled_chunk_count)
       {
-        m_release(item);
+        return false;
       }
+
+      m_block_pool.reset(block_byte ? new memory_pool<>(block_byte) : nullptr);
     }
+
+    m_coalesce_threshold = threshold;
+    return true;
   }
 
-public:
   void add(const void* data, const size_t len)
   {
+    if (len && len < m_coalesce_threshold && coalesce(data, len))
+    {
+      m_copied_byte += len;
+      m_available_byte += len;
+
+      if (m_release)
+      {
+        m_release(std::make_pair(data, len));
+      }
+      return;
+    }
+
     m_memory_chunk.emplace_back(std::make_pair(data, len));
     m_available_byte += len;
+    m_referenced_byte += len;
   }
 
   // Move the stream forward by the specified number of bytes from the current position.
@@ -124,9 +169,13 @@ public:
       {
         len -= left;
         m_first_chunk_useful_pos = 0;
-        if (m_release)
+        if (m_marked)
         {
-          m_release(m_memory_chunk.front());
+          m_retained_chunk.emplace_back(m_memory_chunk.front());
+        }
+        else
+        {
+          release_chunk(m_memory_chunk.front());
         }
         m_memory_chunk.pop_front();
       }
@@ -135,6 +184,56 @@ public:
     return out;
   }
 
+  // Remember the current position, rewind moves the stream back to it.
+  // Chunks slid over after the mark are retained without copying until commit.
+  // Note: If a mark is already set, it is committed first.
+  void mark()
+  {
+    commit();
+
+    m_marked = true;
+    m_mark_first_chunk_useful_pos = m_first_chunk_useful_pos;
+    m_mark_already_slide_byte = m_already_slide_byte;
+  }
+
+  // Move the stream back to the marked position, the mark is kept.
+  // Return false if no mark is set.
+  bool rewind()
+  {
+    if (!m_marked)
+    {
+      return false;
+    }
+
+    while (!m_retained_chunk.empty())
+    {
+      m_memory_chunk.emplace_front(m_retained_chunk.back());
+      m_retained_chunk.pop_back();
+    }
+
+    m_first_chunk_useful_pos = m_mark_first_chunk_useful_pos;
+    m_available_byte += m_already_slide_byte - m_mark_already_slide_byte;
+    m_already_slide_byte = m_mark_already_slide_byte;
+    return true;
+  }
+
+  // Drop the mark and release the chunks retained by it.
+  void commit()
+  {
+    for (const auto& item : m_retained_chunk)
+    {
+      release_chunk(item);
+    }
+
+    m_retained_chunk.clear();
+    m_marked = false;
+  }
+
+  const bool is_marked() const
+  {
+    return m_marked;
+  }
+
   // Find the target and return its pos.
   // Return -1 if the target is not found.
   const size_t find(
@@ -147,66 +246,181 @@ public:
       return 0;
     }
 
-    size_t chunk_index = 0;
-    size_t move_byte_count = 0;
-    auto   first_chunk_useful_pos = m_first_chunk_useful_pos;
+    if (m_available_byte < target_byte)
+    {
+      return static_cast<size_t>(-1);
+    }
 
-    std::unique_ptr<unsigned char[]> head_buff;
+    auto result = static_cast<size_t>(-1);
+    find_range(
+      0,
+      m_available_byte - target_byte + 1,
+      target,
+      target_byte,
+      allow_error_bit_count,
+      [&result](const size_t pos)
+      {
+        result = pos;
+        return false;
+      });
 
-    while (m_available_byte - move_byte_count >= target_byte)
+    return result;
+  }
+
+  // Find every occurrence of the target (overlapping occurrences included).
+  // Return the positions in ascending order, an empty target has no occurrence.
+  std::vector<size_t> find_all(
+    const void*  target,
+    const size_t target_byte,
+    const size_t allow_error_bit_count = 0) const
+  {
+    std::vector<size_t> result;
+    if (!target_byte || m_available_byte < target_byte)
     {
-      assert(chunk_index < m_memory_chunk.size());
-      assert(m_available_byte > move_byte_count);
-      assert(m_memory_chunk.size() > chunk_index);
+      return result;
+    }
 
-      auto& data = m_memory_chunk[chunk_index];
-      if (data.second - first_chunk_useful_pos >= target_byte)
+    find_range(
+      0,
+      m_available_byte - target_byte + 1,
+      target,
+      target_byte,
+      allow_error_bit_count,
+      [&result](const size_t pos)
       {
-        if (bit_cmp(
-              static_cast<const unsigned char*>(data.first) + first_chunk_useful_pos,
-              target,
-              target_byte,
-              allow_error_bit_count))
-        {
-          return move_byte_count;
-        }
+        result.emplace_back(pos);
+        return true;
+      });
 
-        ++first_chunk_useful_pos;
-        ++move_byte_count;
-        continue;
-      }
+    return result;
+  }
 
-      if (!head_buff)
-      {
-        head_buff.reset(new unsigned char[target_byte]);
-      }
+  // Same as find, but the stream is split into segment_count segments which are scanned on pool.
+  // pool: anything providing submit_task(task) -> std::future, for example BS::thread_pool.
+  // segment_count: 0 means one segment per thread of the pool.
+  // Note: the stream must not be modified until the function returns.
+  template<typename t_pool>
+  size_t find_parallel(
+    t_pool&      pool,
+    const void*  target,
+    const size_t target_byte,
+    const size_t allow_error_bit_count = 0,
+    size_t       segment_count = 0) const
+  {
+    if (!target_byte)
+    {
+      return 0;
+    }
+
+    if (m_available_byte < target_byte)
+    {
+      return static_cast<size_t>(-1);
+    }
+
+    const auto pos_count = m_available_byte - target_byte + 1;
+    segment_count = parallel_segment_count(pool, pos_count, segment_count);
 
-      while (data.second > first_chunk_useful_pos)
+    // the smallest pos found so far, segments located behind it stop scanning.
+    std::atomic<size_t> result{ static_cast<size_t>(-1) };
+
+    auto task = [this, &result, target, target_byte, allow_error_bit_count](
+                  size_t begin_pos,
+                  const size_t end_pos)
+    {
+      while (begin_pos < end_pos && begin_pos < result.load(std::memory_order_relaxed))
       {
-        if (peek(head_buff.get(), target_byte, move_byte_count) == target_byte)
-        {
-          if (bit_cmp(head_buff.get(), target, target_byte, allow_error_bit_count))
+        const auto stride_end = (std::min)(end_pos, begin_pos + parallel_stride_byte);
+        find_range(
+          begin_pos,
+          stride_end,
+          target,
+          target_byte,
+          allow_error_bit_count,
+          [&result](const size_t pos)
           {
-            return move_byte_count;
-          }
-          else
-          {
-            ++first_chunk_useful_pos;
-            ++move_byte_count;
-            continue;
-          }
-        }
-        else
-        {
-          return static_cast<size_t>(-1);
-        }
+            auto current = result.load(std::memory_order_relaxed);
+            while (pos < current && !result.compare_exchange_weak(current, pos))
+            {
+            }
+            return false;
+          });
+        begin_pos = stride_end;
       }
+    };
 
-      ++chunk_index;
-      first_chunk_useful_pos = 0;
+    std::vector<std::future<void>> futures;
+    futures.reserve(segment_count);
+    for (size_t i = 0; i < segment_count; ++i)
+    {
+      futures.emplace_back(pool.submit_task(
+        std::bind(task, pos_count * i / segment_count, pos_count * (i + 1) / segment_count)));
+    }
+
+    for (auto& item : futures)
+    {
+      item.get();
+    }
+
+    return result.load();
+  }
+
+  // Same as find_all, but the stream is split into segment_count segments scanned on pool.
+  // Every segment overlaps the next one by target_byte - 1 bytes, so no occurrence is missed.
+  // pool: anything providing submit_task(task) -> std::future, for example BS::thread_pool.
+  // segment_count: 0 means one segment per thread of the pool.
+  // Note: the stream must not be modified until the function returns.
+  template<typename t_pool>
+  std::vector<size_t> find_all_parallel(
+    t_pool&      pool,
+    const void*  target,
+    const size_t target_byte,
+    const size_t allow_error_bit_count = 0,
+    size_t       segment_count = 0) const
+  {
+    if (!target_byte || m_available_byte < target_byte)
+    {
+      return {};
+    }
+
+    const auto pos_count = m_available_byte - target_byte + 1;
+    segment_count = parallel_segment_count(pool, pos_count, segment_count);
+
+    auto task = [this, target, target_byte, allow_error_bit_count](
+                  const size_t begin_pos,
+                  const size_t end_pos)
+    {
+      std::vector<size_t> result;
+      find_range(
+        begin_pos,
+        end_pos,
+        target,
+        target_byte,
+        allow_error_bit_count,
+        [&result](const size_t pos)
+        {
+          result.emplace_back(pos);
+          return true;
+        });
+      return result;
+    };
+
+    std::vector<std::future<std::vector<size_t>>> futures;
+    futures.reserve(segment_count);
+    for (size_t i = 0; i < segment_count; ++i)
+    {
+      futures.emplace_back(pool.submit_task(
+        std::bind(task, pos_count * i / segment_count, pos_count * (i + 1) / segment_count)));
     }
 
-    return static_cast<size_t>(-1);
+    // the segments are ordered, so merging them in turn keeps the positions ascending.
+    std::vector<size_t> result;
+    for (auto& item : futures)
+    {
+      auto part = item.get();
+      result.insert(result.end(), part.begin(), part.end());
+    }
+
+    return result;
   }
 
   // Read the specified bytes of data from the stream at the given offset.
@@ -269,13 +483,263 @@ public:
     return m_available_byte;
   }
 
+  // The number of bytes copied into pooled blocks by add.
+  size_t copied_byte() const
+  {
+    return m_copied_byte;
+  }
+
+  // The number of bytes referenced by add without copying.
+  size_t referenced_byte() const
+  {
+    return m_referenced_byte;
+  }
+
 private:
-  release_type            m_release;
-  std::deque<memory_type> m_memory_chunk;
+  struct chunk_type : public memory_type
+  {
+    chunk_type(const memory_type& memory, const bool pooled = false)
+      : memory_type(memory)
+      , pooled(pooled)
+    {
+    }
+
+    // true if the chunk is a block of m_block_pool.
+    bool pooled;
+  };
+
+  void release_chunk(const chunk_type& chunk)
+  {
+    if (chunk.pooled)
+    {
+      m_block_pool->free(const_cast<void*>(chunk.first));
+      --m_pooled_chunk_count;
+    }
+    else if (m_release)
+    {
+      m_release(chunk);
+    }
+  }
+
+  // Append the data to the pooled block at the back, new blocks are taken from m_block_pool when
+  // it is full.
+  // Return false if the pool is out of memory, nothing is appended in this case.
+  bool coalesce(const void* data, size_t len)
+  {
+    assert(m_block_pool);
+
+    const auto block_byte = m_block_pool->node_size();
+    auto       tail_left = static_cast<size_t>(0);
+    if (!m_memory_chunk.empty() && m_memory_chunk.back().pooled)
+    {
+      tail_left = block_byte - m_memory_chunk.back().second;
+    }
+
+    assert(len <= block_byte);
+
+    void* block = nullptr;
+    if (tail_left < len)
+    {
+      block = m_block_pool->malloc();
+      if (!block)
+      {
+        return false;
+      }
+    }
+
+    auto input = static_cast<const unsigned char*>(data);
+    if (tail_left)
+    {
+      auto& tail = m_memory_chunk.back();
+      auto  copy_len = (std::min)(tail_left, len);
+      memcpy(
+        static_cast<unsigned char*>(const_cast<void*>(tail.first)) + tail.second,
+        input,
+        copy_len);
+
+      tail.second += copy_len;
+      input += copy_len;
+      len -= copy_len;
+    }
+
+    if (len)
+    {
+      memcpy(block, input, len);
+      m_memory_chunk.emplace_back(std::make_pair(static_cast<const void*>(block), len), true);
+      ++m_pooled_chunk_count;
+    }
+
+    return true;
+  }
+
+  // a parallel segment is never smaller than this, small streams are not worth splitting.
+  static constexpr size_t parallel_min_segment_byte = 64 * 1024;
+
+  // find_parallel checks whether an earlier segment already found the target every stride.
+  static constexpr size_t parallel_stride_byte = 1024 * 1024;
+
+  template<typename t_pool>
+  static size_t parallel_segment_count(
+    t_pool&      pool,
+    const size_t pos_count,
+    size_t       segment_count)
+  {
+    if (!segment_count)
+    {
+      segment_count = pool.get_thread_count();
+    }
+
+    segment_count = (std::min)(segment_count, pos_count / parallel_min_segment_byte);
+    return (std::max)(segment_count, static_cast<size_t>(1));
+  }
+
+  // Locate the chunk holding the byte at pos.
+  void locate(const size_t pos, size_t& chunk_index, size_t& chunk_pos) const
+  {
+    chunk_index = 0;
+    chunk_pos = m_first_chunk_useful_pos + pos;
+
+    while (chunk_pos >= m_memory_chunk[chunk_index].second)
+    {
+      chunk_pos -= m_memory_chunk[chunk_index].second;
+      ++chunk_index;
+      assert(chunk_index < m_memory_chunk.size());
+    }
+  }
+
+  // Copy len bytes starting at the given chunk position, the bytes must be available.
+  void copy_from(size_t chunk_index, size_t chunk_pos, void* output, size_t len) const
+  {
+    auto out = static_cast<unsigned char*>(output);
+
+    while (len)
+    {
+      assert(chunk_index < m_memory_chunk.size());
+
+      auto& data = m_memory_chunk[chunk_index];
+      auto  copy_len = (std::min)(len, data.second - chunk_pos);
+      memcpy(out, static_cast<const unsigned char*>(data.first) + chunk_pos, copy_len);
+
+      out += copy_len;
+      len -= copy_len;
+      ++chunk_index;
+      chunk_pos = 0;
+    }
+  }
+
+  // Compare the target with every pos in [begin_pos, end_pos) and call on_match(pos) on success,
+  // the scan stops when on_match returns false.
+  // Note: end_pos + target_byte - 1 must not exceed m_available_byte.
+  template<typename t_callback>
+  void find_range(
+    size_t       begin_pos,
+    const size_t end_pos,
+    const void*  target,
+    const size_t target_byte,
+    const size_t allow_error_bit_count,
+    t_callback&& on_match) const
+  {
+    assert(target_byte);
+    assert(end_pos + target_byte - 1 <= m_available_byte);
+
+    if (begin_pos >= end_pos)
+    {
+      return;
+    }
+
+    size_t chunk_index = 0;
+    size_t chunk_pos = 0;
+    locate(begin_pos, chunk_index, chunk_pos);
+
+    const auto first_byte = *static_cast<const unsigned char*>(target);
+
+    std::unique_ptr<unsigned char[]> head_buff;
+
+    while (begin_pos < end_pos)
+    {
+      assert(chunk_index < m_memory_chunk.size());
+
+      auto&      data = m_memory_chunk[chunk_index];
+      const auto left = data.second - chunk_pos;
+      const auto base = static_cast<const unsigned char*>(data.first) + chunk_pos;
+
+      if (left >= target_byte)
+      {
+        // the target fits in this chunk for every pos in the run, compare in place.
+        const auto run = (std::min)(left - target_byte + 1, end_pos - begin_pos);
+
+        for (size_t i = 0; i < run; ++i)
+        {
+          if (!allow_error_bit_count)
+          {
+            auto hit = static_cast<const unsigned char*>(memchr(base + i, first_byte, run - i));
+            if (!hit)
+            {
+              break;
+            }
+            i = hit - base;
+          }
+
+          if (bit_cmp(base + i, target, target_byte, allow_error_bit_count))
+          {
+            if (!on_match(begin_pos + i))
+            {
+              return;
+            }
+          }
+        }
+
+        begin_pos += run;
+        chunk_pos += run;
+        continue;
+      }
+
+      if (!left)
+      {
+        ++chunk_index;
+        chunk_pos = 0;
+        continue;
+      }
+
+      // the target spans several chunks.
+      if (!head_buff)
+      {
+        head_buff.reset(new unsigned char[target_byte]);
+      }
+
+      copy_from(chunk_index, chunk_pos, head_buff.get(), target_byte);
+      if (bit_cmp(head_buff.get(), target, target_byte, allow_error_bit_count))
+      {
+        if (!on_match(begin_pos))
+        {
+          return;
+        }
+      }
+
+      ++begin_pos;
+      ++chunk_pos;
+    }
+  }
+
+private:
+  release_type                m_release;
+  std::pmr::deque<chunk_type> m_memory_chunk;
+
+  std::unique_ptr<memory_pool<>> m_block_pool;
+  size_t                         m_pooled_chunk_count{ 0 };
+  size_t                         m_coalesce_threshold{ 0 };
+  size_t                         m_copied_byte{ 0 };
+  size_t                         m_referenced_byte{ 0 };
 
   size_t m_first_chunk_useful_pos = 0;
   size_t m_already_slide_byte{ 0 };
   size_t m_available_byte{ 0 };
+
+  // chunks slid over since mark, in stream order.
+  std::pmr::deque<chunk_type> m_retained_chunk;
+  bool                        m_marked{ false };
+  size_t                      m_mark_first_chunk_useful_pos{ 0 };
+  size_t                      m_mark_already_slide_byte{ 0 };
 };
 
 } // namespace nly
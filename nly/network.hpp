@@ -3,18 +3,32 @@
 
 #include "boost/asio.hpp"
 #include "boost/beast.hpp"
+#include "nly/memory_stream.hpp"
+#include "nly/http_timing.hpp"
+#include "nly/socket_options.hpp"
 #include "nly/time/time_count.hpp"
 #include <optional>
+#include <functional>
+#include <atomic>
 #include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <charconv>
 #include <sstream>
+#include <limits>
 #include <memory>
 #include <vector>
 #include <chrono>
+#include <string_view>
+#include <memory_resource>
 
 namespace nly
 {
 namespace beast_http = boost::beast::http;
 
+// header fields allocated from a std::pmr::memory_resource, see nly/memory_resource.hpp.
+typedef beast_http::basic_fields<std::pmr::polymorphic_allocator<char>> pmr_fields;
+
 inline std::optional<boost::asio::ip::tcp::endpoint> make_tcp_endpoint(
   const std::string& ip,
   const int          port)
@@ -56,6 +70,90 @@ inline beast_http::response<Body, Fields> make_response_msg(
   return result;
 }
 
+// Calls visit(boost::asio::const_buffer) with the pieces of the serialized msg in order, the body
+// is not copied.
+// return: false if the body can't be serialized.
+template<bool isRequest, typename Body, typename Fields, typename t_visit>
+inline bool visit_serialized(
+  const beast_http::message<isRequest, Body, Fields>& msg,
+  t_visit&&                                           visit)
+{
+  beast_http::serializer<isRequest, Body, Fields> sr(msg);
+  boost::system::error_code                       ec;
+  while (!sr.is_done())
+  {
+    size_t len = 0;
+    sr.next(
+      ec,
+      [&visit, &len](boost::system::error_code&, const auto& buffers)
+      {
+        for (auto it = boost::asio::buffer_sequence_begin(buffers);
+             it != boost::asio::buffer_sequence_end(buffers);
+             ++it)
+        {
+          boost::asio::const_buffer item = *it;
+          visit(item);
+          len += item.size();
+        }
+      });
+    if (ec)
+    {
+      return false;
+    }
+    sr.consume(len);
+  }
+
+  return true;
+}
+
+// The exact number of bytes msg serializes to, 0 if it can't be serialized.
+// Note: The body is serialized to count it, a body read from a file is read twice.
+template<bool isRequest, typename Body, typename Fields>
+inline size_t serialized_size(const beast_http::message<isRequest, Body, Fields>& msg)
+{
+  size_t result = 0;
+  auto   ok =
+    visit_serialized(msg, [&result](boost::asio::const_buffer item) { result += item.size(); });
+  return ok ? result : 0;
+}
+
+// Serializes msg into the capacity bytes at out, see serialized_size for the space needed.
+// return: the number of bytes written, 0 if out is too small or msg can't be serialized.
+template<bool isRequest, typename Body, typename Fields>
+inline size_t serialize_to(
+  const beast_http::message<isRequest, Body, Fields>& msg,
+  void*                                               out,
+  size_t                                              capacity)
+{
+  size_t len = 0;
+  bool   fit = true;
+  auto   ok = visit_serialized(
+    msg,
+    [out, capacity, &len, &fit](boost::asio::const_buffer item)
+    {
+      if (!fit || item.size() > capacity - len)
+      {
+        fit = false;
+        return;
+      }
+
+      memcpy(static_cast<char*>(out) + len, item.data(), item.size());
+      len += item.size();
+    });
+  return ok && fit ? len : 0;
+}
+
+// Serializes msg into a string of the exact size allocated from resource, such as a pool.
+template<bool isRequest, typename Body, typename Fields>
+inline std::pmr::string msg_to_pmr_string(
+  const beast_http::message<isRequest, Body, Fields>& msg,
+  std::pmr::memory_resource*                          resource = std::pmr::get_default_resource())
+{
+  std::pmr::string result(serialized_size(msg), '\0', resource);
+  result.resize(serialize_to(msg, result.data(), result.size()));
+  return result;
+}
+
 template<typename T>
 inline std::string msg_to_string(const T& msg)
 {
@@ -64,8 +162,196 @@ inline std::string msg_to_string(const T& msg)
   return osm.str();
 }
 
+// messages are copied once into a string of the exact size.
+template<bool isRequest, typename Body, typename Fields>
+inline std::string msg_to_string(const beast_http::message<isRequest, Body, Fields>& msg)
+{
+  std::string result(serialized_size(msg), '\0');
+  result.resize(serialize_to(msg, result.data(), result.size()));
+  return result;
+}
+
+// A request of which the start line and the header fields are serialized once, only the target
+// and the body are written per request. Content-Length is set as prepare_payload does.
+class prebaked_request
+{
+public:
+  // fields: the header fields of every request, except Content-Length and Transfer-Encoding.
+  // resource: where the buffer of build is allocated from.
+  template<typename Fields = beast_http::fields>
+  prebaked_request(
+    beast_http::verb           method,
+    const Fields&              fields = {},
+    unsigned int               version = 11,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    : m_method(resource)
+    , m_version(resource)
+    , m_fields(resource)
+    , m_buffer(resource)
+    , m_always_length(
+        method == beast_http::verb::options || method == beast_http::verb::put ||
+        method == beast_http::verb::post)
+  {
+    auto method_string = beast_http::to_string(method);
+    m_method.append(method_string.data(), method_string.size()).append(" ");
+    m_version.append(" HTTP/")
+      .append(std::to_string(version / 10))
+      .append(".")
+      .append(std::to_string(version % 10))
+      .append("\r\n");
+
+    for (auto& item : fields)
+    {
+      if (
+        item.name() == beast_http::field::content_length ||
+        item.name() == beast_http::field::transfer_encoding)
+      {
+        continue;
+      }
+
+      auto name = item.name_string();
+      auto value = item.value();
+      m_fields.append(name.data(), name.size()).append(": ");
+      m_fields.append(value.data(), value.size()).append("\r\n");
+    }
+  }
+
+public:
+  // the exact size of the request with target and body.
+  size_t size(std::string_view target, std::string_view body = {}) const
+  {
+    char length[48];
+    return m_method.size() + target.size() + m_version.size() + m_fields.size() +
+           content_length(body.size(), length).size() + 2 + body.size();
+  }
+
+  // Writes the request into the capacity bytes at out.
+  // return: the number of bytes written, 0 if out is too small.
+  size_t write_to(std::string_view target, std::string_view body, void* out, size_t capacity) const
+  {
+    char length[48];
+    auto length_field = content_length(body.size(), length);
+
+    const std::string_view parts[] = {
+      m_method, target, m_version, m_fields, length_field, "\r\n", body
+    };
+
+    size_t len = 0;
+    for (auto& item : parts)
+    {
+      len += item.size();
+    }
+    if (len > capacity)
+    {
+      return 0;
+    }
+
+    auto pos = static_cast<char*>(out);
+    for (auto& item : parts)
+    {
+      if (!item.empty())
+      {
+        memcpy(pos, item.data(), item.size());
+        pos += item.size();
+      }
+    }
+    return len;
+  }
+
+  // Writes the request into a buffer owned by the object, which is reused by the next call.
+  // return: the request, to be sent by http_client::deal_command.
+  boost::asio::const_buffer build(std::string_view target, std::string_view body = {})
+  {
+    m_buffer.resize(size(target, body));
+    write_to(target, body, m_buffer.data(), m_buffer.size());
+    return boost::asio::buffer(m_buffer.data(), m_buffer.size());
+  }
+
+private:
+  // the Content-Length field written into buffer, empty if the request has none.
+  std::string_view content_length(size_t body_byte, char (&buffer)[48]) const
+  {
+    if (!body_byte && !m_always_length)
+    {
+      return {};
+    }
+
+    static constexpr std::string_view name = "Content-Length: ";
+    memcpy(buffer, name.data(), name.size());
+    auto end = std::to_chars(buffer + name.size(), buffer + sizeof(buffer) - 2, body_byte).ptr;
+    *end++ = '\r';
+    *end++ = '\n';
+    return std::string_view(buffer, end - buffer);
+  }
+
+private:
+  std::pmr::string m_method;
+  std::pmr::string m_version;
+  std::pmr::string m_fields;
+  std::pmr::string m_buffer;
+  bool             m_always_length;
+};
+
+// Receives the body of a response fragment by fragment, see http_client::deal_command_streaming.
+// return: false to stop reading, the connection is closed then.
+typedef std::function<bool(const void* data, size_t len)> body_sink;
+
+// frees the fragments copied by make_memory_stream_sink.
+inline void release_body_fragment(const memory_stream::memory_type& memory)
+{
+  delete[] static_cast<const unsigned char*>(memory.first);
+}
+
+// Appends a copy of every fragment to stream, which must be constructed with
+// release_body_fragment.
+inline body_sink make_memory_stream_sink(memory_stream& stream)
+{
+  return [&stream](const void* data, size_t len)
+  {
+    auto copy = new (std::nothrow) unsigned char[len];
+    if (!copy)
+    {
+      return false;
+    }
+
+    memcpy(copy, data, len);
+    stream.add(copy, len);
+    return true;
+  };
+}
+
+// Writes every fragment to the file at path, which is truncated.
+// return: an empty sink if the file can't be opened.
+inline body_sink make_file_sink(const std::string& path)
+{
+  auto file = std::shared_ptr<std::FILE>(
+    std::fopen(path.c_str(), "wb"),
+    [](std::FILE* f)
+    {
+      if (f)
+      {
+        std::fclose(f);
+      }
+    });
+  if (!file)
+  {
+    return nullptr;
+  }
+
+  return [file](const void* data, size_t len)
+  { return std::fwrite(data, 1, len, file.get()) == len; };
+}
+
 class http_client
 {
+public:
+  // (host, service, max_wait_time) -> endpoints, empty if it failed, see set_resolver.
+  typedef std::function<std::vector<boost::asio::ip::tcp::endpoint>(
+    const std::string&,
+    const std::string&,
+    std::chrono::milliseconds)>
+    resolver_type;
+
 public:
   static std::vector<boost::asio::ip::tcp::endpoint> resolve(
     const std::string&           host,
@@ -98,7 +384,7 @@ public:
         }
       });
 
-    http_client::wait(finish, cxt, start_time, max_wait_time, early_terminate);
+    http_client::wait(finish, cxt, start_time + max_wait_time, early_terminate);
 
     if (!finish)
     {
@@ -109,24 +395,47 @@ public:
     return result;
   }
 
+  // early_terminate is called at this interval while waiting, use cancel to stop at once.
+  static constexpr std::chrono::milliseconds early_terminate_interval{ 10 };
+
 private:
+  // runs cxt until finish is set, the deadline passes, early_terminate returns true or cancel_count
+  // differs from cancel_start.
   static void wait(
-    bool&                                                finish,
-    boost::asio::io_context&                             cxt,
-    std::optional<std::chrono::steady_clock::time_point> startTime = {},
-    std::optional<std::chrono::milliseconds>             max_wait_time = {},
-    const std::function<bool()>&                         early_terminate = nullptr)
+    bool&                                  finish,
+    boost::asio::io_context&               cxt,
+    std::optional<nly::time_point>         deadline = {},
+    const std::function<bool()>&           early_terminate = nullptr,
+    const std::atomic<unsigned long long>* cancel_count = nullptr,
+    unsigned long long                     cancel_start = 0)
   {
     while (!finish)
     {
-      if (!cxt.poll())
+      if (cancel_count && *cancel_count != cancel_start)
       {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        break;
       }
 
-      if (
-        early_terminate && early_terminate() ||
-        startTime && max_wait_time && nly::time_diff_ms(*startTime) >= max_wait_time->count())
+      if (!deadline && !early_terminate)
+      {
+        cxt.run_one();
+        continue;
+      }
+
+      auto now = nly::now();
+      if (deadline && now >= *deadline)
+      {
+        break;
+      }
+
+      auto until = deadline ? *deadline : now + early_terminate_interval;
+      if (early_terminate)
+      {
+        until = (std::min)(until, now + early_terminate_interval);
+      }
+      cxt.run_one_until(until);
+
+      if (!finish && early_terminate && early_terminate())
       {
         break;
       }
@@ -134,8 +443,14 @@ private:
   }
 
 public:
-  http_client()
+  // resource: where the send and receive buffers are allocated from.
+  // max_recv_byte: the most bytes buffered while reading a response, a header larger than it fails.
+  http_client(
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource(),
+    size_t                     max_recv_byte = (std::numeric_limits<size_t>::max)())
     : m_sock(m_cxt)
+    , m_recv_buffer(max_recv_byte, std::pmr::polymorphic_allocator<char>(resource))
+    , m_send_buffer(resource)
     , m_guard(
         std::make_shared<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>>(
           boost::asio::make_work_guard(m_cxt)))
@@ -159,6 +474,55 @@ public:
     return m_connected;
   }
 
+  // The phases of the last request, with the resolution of set_host and the connection if they
+  // were run for it. For a pipelined deal_commands it covers the whole batch, header_end is then
+  // the end of the first response.
+  const http_timing& get_timing() const
+  {
+    return m_timing;
+  }
+
+  // Sets options on the socket of every connection, applied at once if connected. Failures are
+  // ignored, check them with socket_options::apply on get_socket if needed.
+  void set_socket_options(const socket_options& options)
+  {
+    m_socket_options = options;
+    if (m_connected)
+    {
+      m_socket_options.apply(m_sock);
+    }
+  }
+
+  const socket_options& get_socket_options() const
+  {
+    return m_socket_options;
+  }
+
+  // Resolves the hosts given to set_host with resolver instead of http_client::resolve, for example
+  // nly::dns_cache::global().resolver() to resolve a host once for the process. nullptr restores
+  // http_client::resolve.
+  void set_resolver(resolver_type resolver)
+  {
+    m_resolver = std::move(resolver);
+  }
+
+  // Records the timing of every request completed by deal_command or deal_command_streaming into
+  // stats, under the host:service given to set_host, or address:port. nullptr stops it.
+  void set_timing_stats(std::shared_ptr<http_timing_stats> stats)
+  {
+    m_timing_stats = std::move(stats);
+  }
+
+  // Stops the connect or deal_command in progress as if it timed out, it may be called from any
+  // thread.
+  void cancel()
+  {
+    ++m_cancel_count;
+
+    // wakes up the waiting thread.
+    boost::asio::post(m_cxt, []() {});
+  }
+
 public:
   bool set_host(const std::vector<boost::asio::ip::tcp::endpoint>& endpoints)
   {
@@ -169,6 +533,9 @@ public:
 
     close();
     m_endpoints = endpoints;
+    m_pipelining = true;
+    m_host = endpoints.front().address().to_string() + ":" +
+             std::to_string(endpoints.front().port());
     return true;
   }
 
@@ -177,13 +544,27 @@ public:
     return set_host(std::vector<boost::asio::ip::tcp::endpoint>{ endpoint });
   }
 
+  // Note: host is resolved on every call unless a caching resolver is set, see set_resolver.
+  // early_terminate is only checked by http_client::resolve.
   bool set_host(
     const std::string&           host,
     const std::string&           service = "http",
     std::chrono::milliseconds    max_wait_time = std::chrono::milliseconds(5000),
     const std::function<bool()>& early_terminate = nullptr)
   {
-    return set_host(http_client::resolve(host, service, max_wait_time, early_terminate));
+    m_timing = http_timing();
+    begin_phase(&http_timing::resolve_start);
+    auto endpoints =
+      m_resolver ? m_resolver(host, service, max_wait_time)
+                 : http_client::resolve(host, service, max_wait_time, early_terminate);
+    if (!set_host(endpoints))
+    {
+      return false;
+    }
+
+    m_timing.resolve_end = nly::now();
+    m_host = host + ":" + service;
+    return true;
   }
 
   // You should call set_host first.
@@ -201,10 +582,13 @@ public:
       return false;
     }
 
-    auto fun = [this, &max_wait_time_for_every_endpoint, &early_terminate](
+    const auto cancel_start = m_cancel_count.load();
+    begin_phase(&http_timing::connect_start);
+
+    auto fun = [this, &max_wait_time_for_every_endpoint, &early_terminate, cancel_start](
                  const boost::asio::ip::tcp::endpoint& addr)
     {
-      auto start_time = std::chrono::steady_clock::now();
+      auto deadline = nly::now() + max_wait_time_for_every_endpoint;
       bool finish = false;
 
       if (m_sock.is_open())
@@ -212,6 +596,11 @@ public:
         m_sock.close();
       }
 
+      // the buffer sizes must be set before connecting.
+      boost::system::error_code ignore;
+      m_sock.open(addr.protocol(), ignore);
+      m_socket_options.apply(m_sock);
+
       m_sock.async_connect(
         addr,
         [this, &finish](boost::system::error_code ec)
@@ -225,12 +614,7 @@ public:
           }
         });
 
-      http_client::wait(
-        finish,
-        m_cxt,
-        start_time,
-        max_wait_time_for_every_endpoint,
-        early_terminate);
+      http_client::wait(finish, m_cxt, deadline, early_terminate, &m_cancel_count, cancel_start);
 
       if (!finish)
       {
@@ -246,13 +630,140 @@ public:
     {
       if (fun(endpoint))
       {
+        m_timing.connect_end = nly::now();
         return true;
       }
+
+      if (m_cancel_count != cancel_start)
+      {
+        break;
+      }
     }
 
     return false;
   }
 
+  // Connects like connect, but races the endpoints as in RFC 8305 (happy eyeballs): the endpoints
+  // are tried alternating between IPv6 and IPv4, the next attempt starts after stagger or as soon
+  // as the previous one fails, the first connected socket wins and the others are closed.
+  // So an unreachable endpoint delays the connection by stagger instead of a whole timeout.
+  // You should call set_host first.
+  bool connect_racing(
+    std::chrono::milliseconds    stagger = std::chrono::milliseconds(250),
+    std::chrono::milliseconds    max_wait_time = std::chrono::milliseconds(5000),
+    const std::function<bool()>& early_terminate = nullptr)
+  {
+    if (m_connected)
+    {
+      return true;
+    }
+
+    if (m_endpoints.empty())
+    {
+      return false;
+    }
+
+    const auto deadline = nly::now() + max_wait_time;
+    const auto cancel_start = m_cancel_count.load();
+    const auto endpoints = interleave(m_endpoints);
+    begin_phase(&http_timing::connect_start);
+
+    std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> attempts;
+    boost::asio::steady_timer                                  timer(m_cxt);
+    size_t                                                     pending = 0;
+    size_t                                                     timer_pending = 0;
+    std::optional<size_t>                                      winner;
+    bool                                                       finish = false;
+
+    // set once the race is over, the handlers still queued then only count themselves.
+    bool done = false;
+
+    std::function<void()> start_next = [&]()
+    {
+      if (done || winner || attempts.size() >= endpoints.size())
+      {
+        return;
+      }
+
+      auto index = attempts.size();
+      attempts.emplace_back(std::make_unique<boost::asio::ip::tcp::socket>(m_cxt));
+      boost::system::error_code ignore;
+      attempts.back()->open(endpoints[index].protocol(), ignore);
+      m_socket_options.apply(*attempts.back());
+      ++pending;
+      attempts.back()->async_connect(
+        endpoints[index],
+        [&, index](boost::system::error_code ec)
+        {
+          --pending;
+          if (done || winner)
+          {
+            return;
+          }
+
+          if (!ec)
+          {
+            winner = index;
+            finish = true;
+          }
+          else if (attempts.size() < endpoints.size())
+          {
+            start_next();
+          }
+          else if (!pending)
+          {
+            finish = true;
+          }
+        });
+
+      // restarting the timer cancels the previous stagger.
+      ++timer_pending;
+      timer.expires_after(stagger);
+      timer.async_wait(
+        [&](boost::system::error_code ec)
+        {
+          --timer_pending;
+          if (!ec && !done)
+          {
+            start_next();
+          }
+        });
+    };
+
+    start_next();
+    http_client::wait(finish, m_cxt, deadline, early_terminate, &m_cancel_count, cancel_start);
+
+    // the handlers refer to the locals, so they must all run before returning.
+    done = true;
+    timer.cancel();
+    for (size_t i = 0; i < attempts.size(); ++i)
+    {
+      if (i != winner)
+      {
+        boost::system::error_code ignore;
+        attempts[i]->close(ignore);
+      }
+    }
+    while (pending || timer_pending)
+    {
+      m_cxt.run_one();
+    }
+
+    if (!winner || !attempts[*winner]->is_open())
+    {
+      return false;
+    }
+
+    if (m_sock.is_open())
+    {
+      m_sock.close();
+    }
+    m_sock = std::move(*attempts[*winner]);
+    m_connected = true;
+    m_timing.connect_end = nly::now();
+    return true;
+  }
+
   // You should call connect first.
   template<
     typename ReqBody,
@@ -264,71 +775,295 @@ public:
     std::chrono::milliseconds                      max_wait_time = std::chrono::milliseconds(5000),
     const std::function<bool()>&                   early_terminate = nullptr)
   {
-    auto start_time = nly::now();
-
-    auto deal_wait =
-      [this, &start_time, &max_wait_time, &early_terminate](bool& finish, bool& success)
+    if (!m_connected)
     {
-      finish = false;
-      success = false;
+      return {};
+    }
 
-      http_client::wait(finish, m_cxt, start_time, max_wait_time, early_terminate);
+    const auto deadline = nly::now() + max_wait_time;
+    const auto cancel_start = m_cancel_count.load();
 
-      if (!finish)
-      {
-        m_sock.cancel();
-        http_client::wait(finish, m_cxt);
-        close();
-        return false;
-      }
+    bool                      finish = false;
+    boost::system::error_code ec;
 
-      assert(finish);
-      if (!success)
+    begin_phase(&http_timing::write_start);
+    beast_http::async_write(
+      m_sock,
+      req,
+      [&finish, &ec](boost::system::error_code error, std::size_t)
       {
-        close();
-        return false;
-      }
+        finish = true;
+        ec = error;
+      });
+    if (!wait_io(finish, ec, deadline, early_terminate, cancel_start))
+    {
+      return {};
+    }
+    m_timing.write_end = nly::now();
+    m_socket_options.rearm_quick_ack(m_sock);
 
-      return true;
-    };
+    return read_response<RepBody, RepFields>(deadline, early_terminate, cancel_start);
+  }
 
+  // Same as deal_command, but req is sent as is, for example a request built by
+  // prebaked_request::build or serialize_to. req must stay valid until the function returns.
+  template<typename RepBody = beast_http::string_body, typename RepFields = beast_http::fields>
+  std::optional<beast_http::response<RepBody, RepFields>> deal_command(
+    boost::asio::const_buffer    req,
+    std::chrono::milliseconds    max_wait_time = std::chrono::milliseconds(5000),
+    const std::function<bool()>& early_terminate = nullptr)
+  {
     if (!m_connected)
     {
       return {};
     }
 
-    bool finish = false;
-    bool success = false;
+    const auto deadline = nly::now() + max_wait_time;
+    const auto cancel_start = m_cancel_count.load();
 
-    beast_http::async_write(
+    bool                      finish = false;
+    boost::system::error_code ec;
+
+    begin_phase(&http_timing::write_start);
+    boost::asio::async_write(
       m_sock,
       req,
-      [&finish, &success](boost::system::error_code ec, std::size_t)
+      [&finish, &ec](boost::system::error_code error, std::size_t)
       {
         finish = true;
-        success = !ec;
+        ec = error;
       });
-    if (!deal_wait(finish, success))
+    if (!wait_io(finish, ec, deadline, early_terminate, cancel_start))
     {
       return {};
     }
+    m_timing.write_end = nly::now();
+    m_socket_options.rearm_quick_ack(m_sock);
 
-    beast_http::response<RepBody, RepFields> rep;
-    beast_http::async_read(
-      m_sock,
-      boost::asio::dynamic_buffer(m_recv_buffer),
-      rep,
-      [&finish, &success](boost::system::error_code ec, std::size_t)
+    return read_response<RepBody, RepFields>(deadline, early_terminate, cancel_start);
+  }
+
+  // Same as deal_command, but the response is read into rep, which is reused by every call: the
+  // body keeps its capacity and the fields return their memory to their allocator. The io
+  // operations allocate from the resource of the client.
+  // So with a pool resource (see nly/memory_resource.hpp) also used by the pmr_fields of rep, a
+  // keep-alive request/response cycle doesn't touch the heap once the buffers have grown.
+  // return: false if the request failed, the content of rep is unspecified then.
+  // You should call connect first.
+  template<typename ReqBody, typename ReqFields, typename RepBody, typename RepFields>
+  bool deal_command(
+    const beast_http::request<ReqBody, ReqFields>& req,
+    beast_http::response<RepBody, RepFields>&      rep,
+    std::chrono::milliseconds                      max_wait_time = std::chrono::milliseconds(5000),
+    const std::function<bool()>&                   early_terminate = nullptr)
+  {
+    if (!m_connected)
+    {
+      return false;
+    }
+
+    const auto deadline = nly::now() + max_wait_time;
+    const auto cancel_start = m_cancel_count.load();
+
+    bool                      finish = false;
+    boost::system::error_code ec;
+
+    auto on_io = bind_allocator(
+      [&finish, &ec](boost::system::error_code error, std::size_t)
       {
         finish = true;
-        success = !ec;
+        ec = error;
       });
-    if (!deal_wait(finish, success))
+
+    // beast would allocate the serializer and the parser of a message, they live here instead.
+    beast_http::serializer<true, ReqBody, ReqFields> sr(req);
+    begin_phase(&http_timing::write_start);
+    beast_http::async_write(m_sock, sr, on_io);
+    if (!wait_io(finish, ec, deadline, early_terminate, cancel_start))
+    {
+      return false;
+    }
+    m_timing.write_end = nly::now();
+    m_socket_options.rearm_quick_ack(m_sock);
+
+    rep.base().clear();
+    clear_body(rep.body(), 0);
+    beast_http::response_parser<RepBody, typename RepFields::allocator_type> parser(std::move(rep));
+
+    finish = false;
+    beast_http::async_read_header(m_sock, m_recv_buffer, parser, on_io);
+    auto result = wait_io(finish, ec, deadline, early_terminate, cancel_start);
+    if (result)
+    {
+      m_timing.header_end = nly::now();
+
+      finish = false;
+      beast_http::async_read(m_sock, m_recv_buffer, parser, on_io);
+      result = wait_io(finish, ec, deadline, early_terminate, cancel_start);
+    }
+    if (result)
+    {
+      end_timing();
+    }
+
+    // the fields may have an allocator that can't be assigned, such as a polymorphic allocator.
+    auto released = parser.release();
+    swap(rep, released);
+    return result;
+  }
+
+  // Sends req and passes the body of the response to sink as it arrives, in fragments of at most
+  // fragment_byte bytes, so a response of any size is read with constant memory. Chunked bodies
+  // are decoded.
+  // max_wait_time applies to the header and to every fragment, a long download is not cut as long
+  // as data keeps arriving.
+  // return: the header of the response, empty if the request failed or sink returned false.
+  // You should call connect first.
+  template<typename ReqBody, typename ReqFields, typename RepFields = beast_http::fields>
+  std::optional<beast_http::response_header<RepFields>> deal_command_streaming(
+    const beast_http::request<ReqBody, ReqFields>& req,
+    const body_sink&                               sink,
+    std::chrono::milliseconds                      max_wait_time = std::chrono::milliseconds(5000),
+    const std::function<bool()>&                   early_terminate = nullptr,
+    size_t                                         fragment_byte = 64 * 1024)
+  {
+    if (!m_connected || !sink || !fragment_byte)
+    {
+      return {};
+    }
+
+    const auto cancel_start = m_cancel_count.load();
+
+    bool                      finish = false;
+    boost::system::error_code ec;
+
+    // need_buffer only means the fragment is full.
+    auto on_io = [&finish, &ec](boost::system::error_code error, std::size_t)
+    {
+      finish = true;
+      ec = error == beast_http::error::need_buffer ? boost::system::error_code() : error;
+    };
+
+    begin_phase(&http_timing::write_start);
+    beast_http::async_write(m_sock, req, on_io);
+    if (!wait_io(finish, ec, nly::now() + max_wait_time, early_terminate, cancel_start))
+    {
+      return {};
+    }
+    m_timing.write_end = nly::now();
+    m_socket_options.rearm_quick_ack(m_sock);
+
+    beast_http::response_parser<beast_http::buffer_body, typename RepFields::allocator_type> parser;
+    parser.body_limit((std::numeric_limits<std::uint64_t>::max)());
+
+    finish = false;
+    beast_http::async_read_header(m_sock, m_recv_buffer, parser, on_io);
+    if (!wait_io(finish, ec, nly::now() + max_wait_time, early_terminate, cancel_start))
     {
       return {};
     }
+    m_timing.header_end = nly::now();
+
+    std::pmr::vector<unsigned char> fragment(fragment_byte, m_send_buffer.get_allocator());
+    while (!parser.is_done())
+    {
+      auto& body = parser.get().body();
+      body.data = fragment.data();
+      body.size = fragment.size();
+
+      finish = false;
+      beast_http::async_read(m_sock, m_recv_buffer, parser, on_io);
+      if (!wait_io(finish, ec, nly::now() + max_wait_time, early_terminate, cancel_start))
+      {
+        return {};
+      }
 
-    return rep;
+      auto len = fragment.size() - body.size;
+      if (len && !sink(fragment.data(), len))
+      {
+        close();
+        return {};
+      }
+    }
+
+    end_timing();
+    return std::move(parser.release().base());
+  }
+
+  // Sends every request back-to-back with a single write and reads the responses in order
+  // (HTTP/1.1 pipelining), saving a round trip per request. The i-th result is the response to
+  // reqs[i], it is empty if the request failed, max_wait_time applies to the whole batch.
+  // If the server closes the connection before every response is read, the remaining requests are
+  // sent one by one on new connections and pipelining is disabled, see set_pipelining.
+  // Note: A request whose response was lost with the connection is sent again, only batch
+  // requests that can be repeated. You should call connect first.
+  template<
+    typename ReqBody,
+    typename ReqFields,
+    typename RepBody = beast_http::string_body,
+    typename RepFields = beast_http::fields>
+  std::vector<std::optional<beast_http::response<RepBody, RepFields>>> deal_commands(
+    const std::vector<beast_http::request<ReqBody, ReqFields>>& reqs,
+    std::chrono::milliseconds max_wait_time = std::chrono::milliseconds(5000),
+    const std::function<bool()>& early_terminate = nullptr)
+  {
+    std::vector<std::optional<beast_http::response<RepBody, RepFields>>> result(reqs.size());
+    if (!m_connected)
+    {
+      return result;
+    }
+
+    const auto deadline = nly::now() + max_wait_time;
+    const auto cancel_start = m_cancel_count.load();
+
+    size_t done = 0;
+    if (m_pipelining && reqs.size() > 1)
+    {
+      auto [count, closed] = pipeline(reqs, result, deadline, early_terminate, cancel_start);
+      if (!closed || count == reqs.size())
+      {
+        return result;
+      }
+
+      done = count;
+      m_pipelining = false;
+    }
+
+    for (; done < reqs.size() && m_cancel_count == cancel_start; ++done)
+    {
+      if (!m_connected && !connect(remaining(deadline), early_terminate))
+      {
+        break;
+      }
+
+      result[done] = deal_command<ReqBody, ReqFields, RepBody, RepFields>(
+        reqs[done],
+        remaining(deadline),
+        early_terminate);
+      if (!result[done])
+      {
+        break;
+      }
+
+      if (!result[done]->keep_alive())
+      {
+        close();
+      }
+    }
+
+    return result;
+  }
+
+  // Whether deal_commands pipelines the requests, it is enabled by set_host and disabled when a
+  // server closes a connection in the middle of a batch.
+  void set_pipelining(bool enable)
+  {
+    m_pipelining = enable;
+  }
+
+  bool is_pipelining() const
+  {
+    return m_pipelining;
   }
 
   void close()
@@ -338,12 +1073,287 @@ public:
     m_sock.close();
   }
 
+private:
+  static std::chrono::milliseconds remaining(nly::time_point deadline)
+  {
+    auto result = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - nly::now());
+    return (std::max)(result, std::chrono::milliseconds(0));
+  }
+
+  // An io handler allocating its operations from the resource of the client. It is bound to the
+  // executor of m_cxt, so asio calls it directly instead of wrapping it in a type erased function.
+  template<typename t_handler>
+  struct bound_handler
+  {
+    typedef std::pmr::polymorphic_allocator<char>  allocator_type;
+    typedef boost::asio::io_context::executor_type executor_type;
+
+    allocator_type get_allocator() const noexcept
+    {
+      return allocator;
+    }
+
+    executor_type get_executor() const noexcept
+    {
+      return executor;
+    }
+
+    template<typename... t_args>
+    void operator()(t_args&&... args)
+    {
+      handler(std::forward<t_args>(args)...);
+    }
+
+    t_handler      handler;
+    allocator_type allocator;
+    executor_type  executor;
+  };
+
+  template<typename t_handler>
+  bound_handler<t_handler> bind_allocator(t_handler handler)
+  {
+    return { std::move(handler), m_send_buffer.get_allocator(), m_cxt.get_executor() };
+  }
+
+  // starts a phase, the phases of the previous request are dropped first.
+  void begin_phase(nly::time_point http_timing::*start)
+  {
+    if (m_timing.write_start != nly::time_point())
+    {
+      m_timing = http_timing();
+    }
+    m_timing.*start = nly::now();
+  }
+
+  // the response was read.
+  void end_timing()
+  {
+    m_timing.body_end = nly::now();
+    if (m_timing_stats)
+    {
+      m_timing_stats->record(m_host, m_timing);
+    }
+  }
+
+  // empties body, keeping its memory if it has a clear member.
+  template<typename t_body>
+  static auto clear_body(t_body& body, int) -> decltype(body.clear(), void())
+  {
+    body.clear();
+  }
+
+  template<typename t_body>
+  static void clear_body(t_body& body, long)
+  {
+    body = t_body();
+  }
+
+  template<typename RepBody, typename RepFields>
+  std::optional<beast_http::response<RepBody, RepFields>> read_response(
+    nly::time_point              deadline,
+    const std::function<bool()>& early_terminate,
+    unsigned long long           cancel_start)
+  {
+    beast_http::response_parser<RepBody, typename RepFields::allocator_type> parser;
+    bool                                                                     finish = false;
+    boost::system::error_code                                                ec;
+
+    auto on_io = [&finish, &ec](boost::system::error_code error, std::size_t)
+    {
+      finish = true;
+      ec = error;
+    };
+
+    beast_http::async_read_header(m_sock, m_recv_buffer, parser, on_io);
+    if (!wait_io(finish, ec, deadline, early_terminate, cancel_start))
+    {
+      return {};
+    }
+    m_timing.header_end = nly::now();
+
+    finish = false;
+    beast_http::async_read(m_sock, m_recv_buffer, parser, on_io);
+    if (!wait_io(finish, ec, deadline, early_terminate, cancel_start))
+    {
+      return {};
+    }
+
+    end_timing();
+    return parser.release();
+  }
+
+  // whether the server closed the connection, as opposed to a timeout or a malformed message.
+  static bool closed_by_peer(const boost::system::error_code& ec)
+  {
+    return ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset ||
+           ec == boost::asio::error::broken_pipe || ec == beast_http::error::end_of_stream;
+  }
+
+  // alternates the address families, starting with the family of the first endpoint, the order
+  // within a family is kept.
+  static std::vector<boost::asio::ip::tcp::endpoint> interleave(
+    const std::vector<boost::asio::ip::tcp::endpoint>& endpoints)
+  {
+    std::vector<boost::asio::ip::tcp::endpoint> first;
+    std::vector<boost::asio::ip::tcp::endpoint> second;
+    for (auto& item : endpoints)
+    {
+      auto& family = item.address().is_v6() == endpoints.front().address().is_v6() ? first : second;
+      family.push_back(item);
+    }
+
+    std::vector<boost::asio::ip::tcp::endpoint> result;
+    for (size_t i = 0; i < first.size() || i < second.size(); ++i)
+    {
+      if (i < first.size())
+      {
+        result.push_back(first[i]);
+      }
+      if (i < second.size())
+      {
+        result.push_back(second[i]);
+      }
+    }
+    return result;
+  }
+
+  // waits for the io on m_sock until finish, it is cancelled at the deadline.
+  // return: false and the connection is closed if the io failed, ec is timed_out if it was
+  // cancelled.
+  bool wait_io(
+    bool&                        finish,
+    boost::system::error_code&   ec,
+    nly::time_point              deadline,
+    const std::function<bool()>& early_terminate,
+    unsigned long long           cancel_start)
+  {
+    http_client::wait(finish, m_cxt, deadline, early_terminate, &m_cancel_count, cancel_start);
+
+    if (!finish)
+    {
+      m_sock.cancel();
+      http_client::wait(finish, m_cxt);
+      ec = boost::asio::error::timed_out;
+    }
+
+    if (ec)
+    {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  // return: the number of responses read, and whether the server closed the connection before
+  // the responses to the other requests.
+  template<typename ReqBody, typename ReqFields, typename RepBody, typename RepFields>
+  std::pair<size_t, bool> pipeline(
+    const std::vector<beast_http::request<ReqBody, ReqFields>>&           reqs,
+    std::vector<std::optional<beast_http::response<RepBody, RepFields>>>& result,
+    nly::time_point                                                       deadline,
+    const std::function<bool()>&                                          early_terminate,
+    unsigned long long                                                    cancel_start)
+  {
+    // the buffers of a serializer are only valid until they are consumed, so the requests are
+    // copied into one buffer.
+    m_send_buffer.clear();
+    for (auto& req : reqs)
+    {
+      beast_http::serializer<true, ReqBody, ReqFields> sr(req);
+      boost::system::error_code                        ec;
+      do
+      {
+        sr.next(
+          ec,
+          [this, &sr](boost::system::error_code&, const auto& buffers)
+          {
+            auto size = boost::asio::buffer_size(buffers);
+            auto pos = m_send_buffer.size();
+            m_send_buffer.resize(pos + size);
+            boost::asio::buffer_copy(
+              boost::asio::buffer(m_send_buffer.data() + pos, size),
+              buffers);
+            sr.consume(size);
+          });
+      } while (!ec && !sr.is_done());
+
+      if (ec)
+      {
+        return { 0, false };
+      }
+    }
+
+    bool                      finish = false;
+    boost::system::error_code ec;
+
+    begin_phase(&http_timing::write_start);
+    boost::asio::async_write(
+      m_sock,
+      boost::asio::buffer(m_send_buffer),
+      [&finish, &ec](boost::system::error_code error, std::size_t)
+      {
+        finish = true;
+        ec = error;
+      });
+    if (!wait_io(finish, ec, deadline, early_terminate, cancel_start))
+    {
+      return { 0, closed_by_peer(ec) };
+    }
+    m_timing.write_end = nly::now();
+    m_socket_options.rearm_quick_ack(m_sock);
+
+    for (size_t i = 0; i < reqs.size(); ++i)
+    {
+      beast_http::response<RepBody, RepFields> rep;
+      finish = false;
+      beast_http::async_read(
+        m_sock,
+        m_recv_buffer,
+        rep,
+        [&finish, &ec](boost::system::error_code error, std::size_t)
+        {
+          finish = true;
+          ec = error;
+        });
+      if (!wait_io(finish, ec, deadline, early_terminate, cancel_start))
+      {
+        return { i, closed_by_peer(ec) };
+      }
+
+      m_timing.body_end = nly::now();
+      if (!i)
+      {
+        m_timing.header_end = m_timing.body_end;
+      }
+
+      result[i] = std::move(rep);
+      if (!result[i]->keep_alive())
+      {
+        close();
+        return { i + 1, true };
+      }
+    }
+
+    return { reqs.size(), false };
+  }
+
+private:
+  typedef boost::beast::basic_flat_buffer<std::pmr::polymorphic_allocator<char>> recv_buffer_type;
+
 private:
   boost::asio::io_context                     m_cxt;
   boost::asio::ip::tcp::socket                m_sock;
   std::vector<boost::asio::ip::tcp::endpoint> m_endpoints;
   bool                                        m_connected{ false };
-  std::vector<unsigned char>                  m_recv_buffer;
+  recv_buffer_type                            m_recv_buffer;
+  std::pmr::vector<unsigned char>             m_send_buffer;
+  bool                                        m_pipelining{ true };
+  std::atomic<unsigned long long>             m_cancel_count{ 0 };
+  std::string                                 m_host;
+  http_timing                                 m_timing;
+  socket_options                              m_socket_options;
+  std::shared_ptr<http_timing_stats>          m_timing_stats;
+  resolver_type                               m_resolver;
 
   std::shared_ptr<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> m_guard;
 };
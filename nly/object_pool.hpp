@@ -0,0 +1,207 @@
+#ifndef NLY_OBJECT_POOL
+#define NLY_OBJECT_POOL
+
+#include "nly/memory_pool.hpp"
+#include <new>
+#include <mutex>
+#include <cassert>
+#include <memory>
+#include <cstddef>
+#include <utility>
+#include <functional>
+
+namespace nly
+{
+
+/**
+ * Pool of objects of type T, constructed and destroyed in place on nodes of t_pool.
+ *
+ * t_pool is memory_pool by default, use memory_pool_s to share the pool between threads or
+ * thread_cached_memory_pool to give every thread its own cache of nodes.
+ *
+ * make_shared allocates the object together with the control block of std::shared_ptr from a
+ * second t_pool, created on first use since the size of the control block is only known then.
+ *
+ * @note The pool must outlive every object, handle and shared_ptr it returns.
+ */
+template<typename T, typename t_pool = memory_pool<>>
+class object_pool
+{
+  static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+
+public:
+  struct deleter
+  {
+    object_pool* pool;
+
+    void operator()(T* p) const
+    {
+      pool->destroy(p);
+    }
+  };
+
+  typedef std::unique_ptr<T, deleter> handle;
+
+  // std::allocate_shared allocator drawing from the shared pool of an object_pool.
+  template<typename U>
+  class shared_allocator
+  {
+  public:
+    typedef U value_type;
+
+  public:
+    shared_allocator(object_pool& pool) noexcept
+      : pool_(&pool)
+    {
+    }
+
+    template<typename V>
+    shared_allocator(const shared_allocator<V>& other) noexcept
+      : pool_(&other.pool())
+    {
+    }
+
+  public:
+    U* allocate(size_t n)
+    {
+      void* p = nullptr;
+      if (n == 1)
+      {
+        p = pool_->init_shared_pool(sizeof(U)).malloc();
+      }
+      else
+      {
+        p = ::operator new(n * sizeof(U), std::nothrow);
+      }
+
+      if (!p)
+      {
+        throw std::bad_alloc();
+      }
+      return static_cast<U*>(p);
+    }
+
+    void deallocate(U* p, size_t n)
+    {
+      if (n == 1)
+      {
+        pool_->init_shared_pool(sizeof(U)).free(p);
+      }
+      else
+      {
+        ::operator delete(p);
+      }
+    }
+
+    object_pool& pool() const
+    {
+      return *pool_;
+    }
+
+    template<typename V>
+    bool operator==(const shared_allocator<V>& other) const
+    {
+      return pool_ == &other.pool();
+    }
+
+    template<typename V>
+    bool operator!=(const shared_allocator<V>& other) const
+    {
+      return pool_ != &other.pool();
+    }
+
+  private:
+    object_pool* pool_;
+  };
+
+public:
+  // args: passed to t_pool after the node size, for example next_size of memory_pool.
+  template<typename... t_args>
+  object_pool(const t_args&... args)
+    : pool_(sizeof(T), args...)
+    , make_shared_pool_([args...](size_t node_size)
+                        { return std::make_unique<t_pool>(node_size, args...); })
+  {
+  }
+
+  object_pool(const object_pool&) = delete;
+  object_pool& operator=(const object_pool&) = delete;
+
+public:
+  // Construct an object in the pool, it must be returned by destroy.
+  // Throws std::bad_alloc if out-of-memory, and whatever the constructor of T throws.
+  template<typename... t_args>
+  T* construct(t_args&&... args)
+  {
+    auto p = pool_.malloc();
+    if (!p)
+    {
+      throw std::bad_alloc();
+    }
+
+    try
+    {
+      return new (p) T(std::forward<t_args>(args)...);
+    }
+    catch (...)
+    {
+      pool_.free(p);
+      throw;
+    }
+  }
+
+  void destroy(T* p)
+  {
+    if (p)
+    {
+      p->~T();
+      pool_.free(p);
+    }
+  }
+
+  // Construct an object owned by the returned handle.
+  template<typename... t_args>
+  handle make_unique(t_args&&... args)
+  {
+    return handle(construct(std::forward<t_args>(args)...), deleter{ this });
+  }
+
+  // Construct an object owned by a std::shared_ptr, the object and the control block share a node.
+  template<typename... t_args>
+  std::shared_ptr<T> make_shared(t_args&&... args)
+  {
+    return std::allocate_shared<T>(shared_allocator<T>(*this), std::forward<t_args>(args)...);
+  }
+
+  t_pool& pool()
+  {
+    return pool_;
+  }
+
+  // the pool of make_shared, null until its first call.
+  t_pool* shared_pool()
+  {
+    return shared_pool_.get();
+  }
+
+private:
+  t_pool& init_shared_pool(size_t node_size)
+  {
+    std::call_once(
+      shared_pool_flag_,
+      [this, node_size]() { shared_pool_ = make_shared_pool_(node_size); });
+
+    assert(shared_pool_->node_size() == node_size);
+    return *shared_pool_;
+  }
+
+private:
+  t_pool                                         pool_;
+  std::function<std::unique_ptr<t_pool>(size_t)> make_shared_pool_;
+  std::once_flag                                 shared_pool_flag_;
+  std::unique_ptr<t_pool>                        shared_pool_;
+};
+
+} // namespace nly
+
+#endif // NLY_OBJECT_POOL
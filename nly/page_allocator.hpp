@@ -0,0 +1,234 @@
+#ifndef NLY_PAGE_ALLOCATOR
+#define NLY_PAGE_ALLOCATOR
+
+#include <new>
+#include <atomic>
+#include <cstddef>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace nly
+{
+
+// The number of mappings made by page_user_allocator, by kind.
+struct page_allocator_stats
+{
+  // backed by explicit huge pages (MAP_HUGETLB).
+  size_t huge_tlb_count{ 0 };
+
+  // backed by normal pages, transparent huge pages were requested with madvise for the blocks of
+  // at least a huge page.
+  size_t transparent_count{ 0 };
+
+  // allocated with operator new, the platform doesn't support the mappings.
+  size_t fallback_count{ 0 };
+
+  // bound to the NUMA node of the allocating thread.
+  size_t numa_bind_count{ 0 };
+
+  // MAP_HUGETLB attempts that failed, usually no huge page was reserved.
+  size_t huge_tlb_failure_count{ 0 };
+};
+
+/**
+ * boost::pool user allocator mapping every block with mmap, use it as t_user_allocator of
+ * memory_pool for large, long-lived pools where TLB misses matter.
+ *
+ * A block of at least huge_page_size is first mapped with MAP_HUGETLB. If no huge page is
+ * available it is mapped with normal pages and madvise(MADV_HUGEPAGE) asks for transparent huge
+ * pages, and the next huge_tlb_retry_interval blocks skip MAP_HUGETLB before it is tried again, so
+ * pages reserved later are picked up. retry_huge_tlb() ends the skipping at once. Smaller blocks
+ * are mapped with normal pages, a huge page would mostly be wasted. Platforms other than Linux use
+ * operator new.
+ *
+ * @param t_numa_local If true, the memory of a block prefers the NUMA node of the thread that
+ * allocates the block, failures are ignored.
+ */
+template<bool t_numa_local = false>
+struct page_user_allocator
+{
+  typedef std::size_t    size_type;
+  typedef std::ptrdiff_t difference_type;
+
+  static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+  // the number of blocks mapped without MAP_HUGETLB after it failed.
+  static constexpr size_t huge_tlb_retry_interval = 64;
+
+  static char* malloc(const size_type bytes)
+  {
+    void*  p = nullptr;
+    size_t len = bytes + sizeof(header_type);
+
+#ifdef __linux__
+    p = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (len >= huge_page_size && !skip_huge_tlb())
+    {
+      auto huge_len = round_up(len, huge_page_size);
+      p = mmap(
+        nullptr,
+        huge_len,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+        -1,
+        0);
+
+      if (p != MAP_FAILED)
+      {
+        len = huge_len;
+        ++counter().huge_tlb_count;
+      }
+      else
+      {
+        ++counter().huge_tlb_failure_count;
+        counter().huge_tlb_skip.store(huge_tlb_retry_interval, std::memory_order_relaxed);
+      }
+    }
+#endif
+
+    if (p == MAP_FAILED)
+    {
+      len = round_up(len, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+      p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED)
+      {
+        return nullptr;
+      }
+
+#ifdef MADV_HUGEPAGE
+      if (len >= huge_page_size)
+      {
+        madvise(p, len, MADV_HUGEPAGE);
+      }
+#endif
+      ++counter().transparent_count;
+    }
+
+    // the pages are not touched yet, so the policy applies to all of them.
+    if constexpr (t_numa_local)
+    {
+      if (bind_local_node(p, len))
+      {
+        ++counter().numa_bind_count;
+      }
+    }
+#else
+    p = ::operator new(len, std::nothrow);
+    if (!p)
+    {
+      return nullptr;
+    }
+    ++counter().fallback_count;
+#endif
+
+    static_cast<header_type*>(p)->len = len;
+    return reinterpret_cast<char*>(static_cast<header_type*>(p) + 1);
+  }
+
+  static void free(char* const block)
+  {
+    auto header = reinterpret_cast<header_type*>(block) - 1;
+
+#ifdef __linux__
+    munmap(header, header->len);
+#else
+    ::operator delete(header);
+#endif
+  }
+
+  // the mappings made by every page_user_allocator<t_numa_local> so far.
+  static page_allocator_stats stats()
+  {
+    page_allocator_stats result;
+    result.huge_tlb_count = counter().huge_tlb_count;
+    result.transparent_count = counter().transparent_count;
+    result.fallback_count = counter().fallback_count;
+    result.numa_bind_count = counter().numa_bind_count;
+    result.huge_tlb_failure_count = counter().huge_tlb_failure_count;
+    return result;
+  }
+
+  // try MAP_HUGETLB again for the next huge block, e.g. after more huge pages were reserved.
+  static void retry_huge_tlb()
+  {
+    counter().huge_tlb_skip.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  struct alignas(std::max_align_t) header_type
+  {
+    size_t len;
+  };
+
+  struct counter_type
+  {
+    std::atomic<size_t> huge_tlb_count{ 0 };
+    std::atomic<size_t> transparent_count{ 0 };
+    std::atomic<size_t> fallback_count{ 0 };
+    std::atomic<size_t> numa_bind_count{ 0 };
+
+    std::atomic<size_t> huge_tlb_failure_count{ 0 };
+
+    // the number of huge blocks left to map without MAP_HUGETLB after it failed.
+    std::atomic<size_t> huge_tlb_skip{ 0 };
+  };
+
+  static counter_type& counter()
+  {
+    static counter_type value;
+    return value;
+  }
+
+  // consumes one skipped MAP_HUGETLB attempt if any is left.
+  static bool skip_huge_tlb()
+  {
+    auto skip = counter().huge_tlb_skip.load(std::memory_order_relaxed);
+    while (skip)
+    {
+      if (counter().huge_tlb_skip.compare_exchange_weak(skip, skip - 1, std::memory_order_relaxed))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static size_t round_up(size_t value, size_t align)
+  {
+    return (value + align - 1) / align * align;
+  }
+
+#ifdef __linux__
+  // mbind(MPOL_PREFERRED) to the node of the calling thread, without depending on libnuma.
+  static bool bind_local_node(void* p, size_t len)
+  {
+    unsigned int cpu = 0;
+    unsigned int node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) || node >= sizeof(unsigned long) * 8)
+    {
+      return false;
+    }
+
+    const int     mpol_preferred = 1;
+    unsigned long node_mask = 1UL << node;
+    return !syscall(SYS_mbind, p, len, mpol_preferred, &node_mask, sizeof(node_mask) * 8, 0);
+  }
+#endif
+};
+
+// huge page backed blocks.
+typedef page_user_allocator<false> huge_page_user_allocator;
+
+// huge page backed blocks on the NUMA node of the allocating thread.
+typedef page_user_allocator<true> numa_local_user_allocator;
+
+} // namespace nly
+
+#endif // NLY_PAGE_ALLOCATOR
@@ -0,0 +1,108 @@
+#ifndef NLY_POOL_TRIMMER
+#define NLY_POOL_TRIMMER
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+namespace nly
+{
+
+// Background thread calling trim_step of its pools every interval, so the free memory of the pools
+// decays even when nothing is freed, see nly::trim_policy. Set trim_policy::on_high_watermark to
+// wake so a pool crossing its high watermark is trimmed without waiting for the interval.
+// A pool is any type with size_t trim_step(), such as memory_pool, thread_cached_memory_pool and
+// size_class_pool. The pools must be thread safe, since they are trimmed on the background thread.
+class pool_trimmer
+{
+public:
+  pool_trimmer(std::chrono::milliseconds interval = std::chrono::milliseconds(1000))
+    : interval_(interval)
+    , thread_([this]() { this->run(); })
+  {
+  }
+
+  pool_trimmer(const pool_trimmer&) = delete;
+  pool_trimmer& operator=(const pool_trimmer&) = delete;
+
+  ~pool_trimmer()
+  {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+public:
+  // return: the id used to remove the pool.
+  // Note: The pool must be removed before it is destroyed.
+  template<typename t_pool>
+  size_t add(t_pool& pool)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    pools_.emplace(++last_id_, [&pool]() { return pool.trim_step(); });
+    return last_id_;
+  }
+
+  // waits for the running step of the pool, if any.
+  void remove(size_t id)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    pools_.erase(id);
+  }
+
+  // Runs a step of every pool now, it may be called from any thread and doesn't block.
+  // Note: A wake racing with the start of a wait may only be noticed at the end of the interval.
+  void wake()
+  {
+    woken_ = true;
+    cv_.notify_all();
+  }
+
+  // the number of bytes returned to the system by every step so far.
+  size_t released_byte() const
+  {
+    return released_byte_;
+  }
+
+private:
+  void run()
+  {
+    std::unique_lock<std::mutex> guard(mutex_);
+    while (true)
+    {
+      cv_.wait_for(guard, interval_, [this]() { return stop_ || woken_; });
+      if (stop_)
+      {
+        break;
+      }
+
+      woken_ = false;
+      for (auto& item : pools_)
+      {
+        released_byte_ += item.second();
+      }
+    }
+  }
+
+private:
+  const std::chrono::milliseconds            interval_;
+  std::mutex                                 mutex_;
+  std::condition_variable                    cv_;
+  bool                                       stop_{ false };
+  size_t                                     last_id_{ 0 };
+  std::map<size_t, std::function<size_t()>> pools_;
+  std::atomic<bool>                          woken_{ false };
+  std::atomic<size_t>                        released_byte_{ 0 };
+  std::thread                                thread_;
+};
+
+} // namespace nly
+
+#endif // NLY_POOL_TRIMMER
@@ -0,0 +1,179 @@
+#ifndef NLY_SIZE_CLASS_POOL
+#define NLY_SIZE_CLASS_POOL
+
+#include "nly/memory_pool.hpp"
+#include "boost/core/bit.hpp"
+#include <new>
+#include <memory>
+#include <vector>
+#include <cassert>
+#include <cstddef>
+
+namespace nly
+{
+
+// Allocator for variable-length memory, built on an array of memory_pool.
+// Pool k serves the sizes in (min_size * 2^(k-1), min_size * 2^k], sizes larger than max_size are
+// allocated from the system.
+// Every allocation is preceded by a small header recording its pool, so free doesn't need the size.
+template<typename t_mutex = boost::signals2::dummy_mutex>
+class size_class_pool
+{
+public:
+  /**
+   * @param min_size The size served by the smallest pool, it must be a power of 2.
+   *
+   * @param max_size The size served by the largest pool, it must be a power of 2 and not less than
+   * min_size.
+   *
+   * @param next_size See memory_pool, it applies to every pool.
+   */
+  size_class_pool(size_t min_size = 64, size_t max_size = 64 * 1024, size_t next_size = 32)
+    : min_shift_(boost::core::bit_width(min_size) - 1)
+    , max_size_(max_size)
+  {
+    assert(boost::core::has_single_bit(min_size));
+    assert(boost::core::has_single_bit(max_size));
+    assert(min_size <= max_size);
+
+    for (auto size = min_size; size <= max_size; size *= 2)
+    {
+      pools_.emplace_back(new memory_pool<t_mutex>(sizeof(header_type) + size, next_size));
+    }
+  }
+
+  size_class_pool(const size_class_pool&) = delete;
+  size_class_pool& operator=(const size_class_pool&) = delete;
+
+public:
+  // returns 0 if out-of-memory.
+  // Note: The memory is aligned to alignof(std::max_align_t).
+  void* malloc(size_t size)
+  {
+    auto index = class_index(size);
+
+    void* p = nullptr;
+    if (index < pools_.size())
+    {
+      p = pools_[index]->malloc();
+    }
+    else
+    {
+      p = ::operator new(sizeof(header_type) + size, std::nothrow);
+    }
+
+    if (!p)
+    {
+      return nullptr;
+    }
+
+    static_cast<header_type*>(p)->index = index;
+    return static_cast<header_type*>(p) + 1;
+  }
+
+  // p must be returned by malloc of this pool, 0 is ignored.
+  void free(void* p)
+  {
+    if (!p)
+    {
+      return;
+    }
+
+    auto header = static_cast<header_type*>(p) - 1;
+    if (header->index < pools_.size())
+    {
+      pools_[header->index]->free(header);
+    }
+    else
+    {
+      ::operator delete(header);
+    }
+  }
+
+  // the number of bytes usable at p, p must be returned by malloc of this pool.
+  // Note: Allocations larger than max_size report max_size + 1.
+  size_t usable_size(const void* p) const
+  {
+    auto index = (static_cast<const header_type*>(p) - 1)->index;
+    return index < pools_.size() ? class_size(index) : max_size_ + 1;
+  }
+
+  // frees every memory block that doesn't have any allocated chunks in every pool.
+  // return: true if at least one memory block was freed.
+  bool release_unused()
+  {
+    bool result = false;
+    for (auto& item : pools_)
+    {
+      result = item->release_unused() || result;
+    }
+    return result;
+  }
+
+  // see memory_pool::set_trim_policy, the watermarks apply to every pool separately.
+  void set_trim_policy(const trim_policy& policy)
+  {
+    for (auto& item : pools_)
+    {
+      item->set_trim_policy(policy);
+    }
+  }
+
+  // see memory_pool::trim_step.
+  // return: the number of bytes returned by every pool.
+  size_t trim_step()
+  {
+    size_t result = 0;
+    for (auto& item : pools_)
+    {
+      result += item->trim_step();
+    }
+    return result;
+  }
+
+  size_t class_count() const
+  {
+    return pools_.size();
+  }
+
+  // the size served by pool index.
+  size_t class_size(size_t index) const
+  {
+    return static_cast<size_t>(1) << (min_shift_ + index);
+  }
+
+private:
+  struct alignas(std::max_align_t) header_type
+  {
+    size_t index;
+  };
+
+  // returns class_count() for sizes larger than max_size.
+  size_t class_index(size_t size) const
+  {
+    if (size > max_size_)
+    {
+      return pools_.size();
+    }
+
+    if (size <= class_size(0))
+    {
+      return 0;
+    }
+
+    // the smallest power of 2 not less than size is 2^bit_width(size - 1).
+    return boost::core::bit_width(size - 1) - min_shift_;
+  }
+
+private:
+  std::vector<std::unique_ptr<memory_pool<t_mutex>>> pools_;
+  const size_t                                       min_shift_;
+  const size_t                                       max_size_;
+};
+
+// thread safe size class pool.
+typedef size_class_pool<std::mutex> size_class_pool_s;
+
+} // namespace nly
+
+#endif // NLY_SIZE_CLASS_POOL
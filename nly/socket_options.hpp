@@ -0,0 +1,176 @@
+#ifndef NLY_SOCKET_OPTIONS
+#define NLY_SOCKET_OPTIONS
+
+#include "boost/asio.hpp"
+#include <chrono>
+#include <optional>
+
+namespace nly
+{
+
+// Options of a TCP socket, set by http_client on connect and by http_server on accept.
+// An empty option keeps the system default. The options the platform lacks are skipped,
+// TCP_QUICKACK, SO_BUSY_POLL and TCP_USER_TIMEOUT are Linux only.
+struct socket_options
+{
+  // TCP_NODELAY, disables Nagle's algorithm which holds a small write until the previous one is
+  // acknowledged.
+  std::optional<bool> no_delay;
+
+  // SO_SNDBUF and SO_RCVBUF, set before connecting so the window scale fits.
+  std::optional<int> send_buffer_byte;
+  std::optional<int> receive_buffer_byte;
+
+  // SO_KEEPALIVE, and when to probe an idle connection: after keep_alive_idle without traffic,
+  // then every keep_alive_interval, the connection is dropped after keep_alive_count probes
+  // without answer.
+  std::optional<bool>                 keep_alive;
+  std::optional<std::chrono::seconds> keep_alive_idle;
+  std::optional<std::chrono::seconds> keep_alive_interval;
+  std::optional<int>                  keep_alive_count;
+
+  // TCP_QUICKACK, acknowledges at once instead of delaying the ACK. Linux clears it as the
+  // connection goes on, so http_client sets it again before reading every response.
+  std::optional<bool> quick_ack;
+
+  // SO_BUSY_POLL, spins on the device queue up to it while reading, trading CPU for latency. It may
+  // need CAP_NET_ADMIN.
+  std::optional<std::chrono::microseconds> busy_poll;
+
+  // TCP_USER_TIMEOUT, the connection is dropped when sent data stays unacknowledged longer.
+  std::optional<std::chrono::milliseconds> user_timeout;
+
+public:
+  // Request/response traffic of small messages: no Nagle, no delayed ACK, and dead peers are
+  // detected within about a minute.
+  static socket_options low_latency()
+  {
+    socket_options result;
+    result.no_delay = true;
+    result.quick_ack = true;
+    result.keep_alive = true;
+    result.keep_alive_idle = std::chrono::seconds(30);
+    result.keep_alive_interval = std::chrono::seconds(5);
+    result.keep_alive_count = 3;
+    result.user_timeout = std::chrono::milliseconds(30000);
+    return result;
+  }
+
+  // Large transfers: 4 MB buffers.
+  static socket_options bulk()
+  {
+    socket_options result;
+    result.no_delay = true;
+    result.send_buffer_byte = 4 * 1024 * 1024;
+    result.receive_buffer_byte = 4 * 1024 * 1024;
+    return result;
+  }
+
+  // Connections kept idle in a pool, probed so the ones a middlebox dropped are noticed.
+  static socket_options pooled()
+  {
+    socket_options result;
+    result.no_delay = true;
+    result.keep_alive = true;
+    result.keep_alive_idle = std::chrono::seconds(30);
+    result.keep_alive_interval = std::chrono::seconds(10);
+    result.keep_alive_count = 3;
+    return result;
+  }
+
+public:
+  // sock must be open.
+  // return: false if an option failed, the others are set anyway.
+  bool apply(boost::asio::ip::tcp::socket& sock) const
+  {
+    bool ok = true;
+    auto set = [&sock, &ok](const auto& option)
+    {
+      boost::system::error_code ec;
+      sock.set_option(option, ec);
+      ok = ok && !ec;
+    };
+
+    if (no_delay)
+    {
+      set(boost::asio::ip::tcp::no_delay(*no_delay));
+    }
+    if (send_buffer_byte)
+    {
+      set(boost::asio::socket_base::send_buffer_size(*send_buffer_byte));
+    }
+    if (receive_buffer_byte)
+    {
+      set(boost::asio::socket_base::receive_buffer_size(*receive_buffer_byte));
+    }
+    if (keep_alive)
+    {
+      set(boost::asio::socket_base::keep_alive(*keep_alive));
+    }
+
+#if defined(TCP_KEEPIDLE)
+    if (keep_alive_idle)
+    {
+      set(tcp_option<TCP_KEEPIDLE>(static_cast<int>(keep_alive_idle->count())));
+    }
+#elif defined(TCP_KEEPALIVE)
+    if (keep_alive_idle)
+    {
+      set(tcp_option<TCP_KEEPALIVE>(static_cast<int>(keep_alive_idle->count())));
+    }
+#endif
+#ifdef TCP_KEEPINTVL
+    if (keep_alive_interval)
+    {
+      set(tcp_option<TCP_KEEPINTVL>(static_cast<int>(keep_alive_interval->count())));
+    }
+#endif
+#ifdef TCP_KEEPCNT
+    if (keep_alive_count)
+    {
+      set(tcp_option<TCP_KEEPCNT>(*keep_alive_count));
+    }
+#endif
+#ifdef TCP_QUICKACK
+    if (quick_ack)
+    {
+      set(tcp_option<TCP_QUICKACK>(*quick_ack));
+    }
+#endif
+#ifdef SO_BUSY_POLL
+    if (busy_poll)
+    {
+      set(boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>(
+        static_cast<int>(busy_poll->count())));
+    }
+#endif
+#ifdef TCP_USER_TIMEOUT
+    if (user_timeout)
+    {
+      set(tcp_option<TCP_USER_TIMEOUT>(static_cast<int>(user_timeout->count())));
+    }
+#endif
+
+    return ok;
+  }
+
+  // Sets TCP_QUICKACK again if it is enabled, see quick_ack.
+  void rearm_quick_ack(boost::asio::ip::tcp::socket& sock) const
+  {
+#ifdef TCP_QUICKACK
+    if (quick_ack.value_or(false))
+    {
+      boost::system::error_code ignore;
+      sock.set_option(tcp_option<TCP_QUICKACK>(1), ignore);
+    }
+#endif
+  }
+
+private:
+  template<int t_name>
+  using tcp_option = boost::asio::detail::socket_option::integer<IPPROTO_TCP, t_name>;
+};
+
+} // namespace nly
+
+#endif // NLY_SOCKET_OPTIONS
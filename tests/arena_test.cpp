@@ -0,0 +1,117 @@
+#include "gtest/gtest.h"
+#include "nly/arena.hpp"
+#include "nly/memory_resource.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+// counts the live blocks requested from upstream.
+class block_counting_resource : public std::pmr::memory_resource
+{
+public:
+  int live = 0;
+  int total = 0;
+
+protected:
+  void* do_allocate(size_t bytes, size_t alignment) override
+  {
+    ++live;
+    ++total;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override
+  {
+    --live;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+  {
+    return this == &other;
+  }
+};
+
+TEST(Arena, Allocate)
+{
+  block_counting_resource upstream;
+  {
+    nly::arena arena(1024, &upstream);
+    EXPECT_EQ(arena.block_size(), 1024);
+
+    auto p0 = static_cast<char*>(arena.allocate(10, 1));
+    auto p1 = static_cast<char*>(arena.allocate(10, 8));
+    EXPECT_EQ(p1 - p0, 16);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(arena.allocate(1, 64)) % 64, 0);
+    EXPECT_EQ(upstream.live, 1);
+    EXPECT_EQ(arena.allocated_byte(), 21);
+
+    // deallocate does nothing.
+    arena.deallocate(p1, 10, 8);
+    EXPECT_NE(arena.allocate(10, 8), p1);
+
+    for (int i = 0; i < 100; ++i)
+    {
+      EXPECT_TRUE(arena.allocate(100, 8));
+    }
+    const auto block_count = upstream.live;
+    EXPECT_TRUE(block_count > 10);
+
+    // an oversized allocation gets a block of its own.
+    auto large = arena.allocate(5000, 128);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(large) % 128, 0);
+    EXPECT_EQ(upstream.live, block_count + 1);
+
+    // the regular blocks are kept and reused.
+    arena.reset();
+    EXPECT_EQ(arena.allocated_byte(), 0);
+    EXPECT_EQ(upstream.live, block_count);
+    EXPECT_EQ(arena.allocate(10, 1), p0);
+    EXPECT_TRUE(arena.allocate(10, 8));
+    EXPECT_TRUE(arena.allocate(1, 64));
+    EXPECT_TRUE(arena.allocate(10, 8));
+    for (int i = 0; i < 100; ++i)
+    {
+      EXPECT_TRUE(arena.allocate(100, 8));
+    }
+    EXPECT_EQ(upstream.live, block_count);
+    EXPECT_EQ(upstream.total, block_count + 1);
+  }
+  EXPECT_EQ(upstream.live, 0);
+}
+
+TEST(Arena, InlineBuffer)
+{
+  block_counting_resource upstream;
+  nly::inline_arena<256>  arena(1024, &upstream);
+
+  std::pmr::vector<int> vec(&arena);
+  vec.reserve(32);
+  EXPECT_EQ(upstream.total, 0);
+
+  vec.reserve(128);
+  EXPECT_EQ(upstream.total, 1);
+
+  arena.release();
+  EXPECT_EQ(upstream.live, 0);
+}
+
+TEST(Arena, MemoryPool)
+{
+  nly::memory_pool<>                            pool(4096);
+  nly::memory_pool_resource<nly::memory_pool<>> blocks(pool);
+  nly::arena                                    arena(4096, &blocks);
+
+  for (int round = 0; round < 3; ++round)
+  {
+    {
+      std::pmr::map<int, std::pmr::string> map(&arena);
+      for (int i = 0; i < 1000; ++i)
+      {
+        map.emplace(i, std::pmr::string(std::to_string(i) + " a string longer than the SSO"));
+      }
+      EXPECT_EQ(map.at(999).substr(0, 3), "999");
+    }
+    arena.reset();
+  }
+}
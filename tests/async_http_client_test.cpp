@@ -0,0 +1,207 @@
+#include "gtest/gtest.h"
+#include "nly/async_http_client.hpp"
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace
+{
+// Serves every connection on a thread of its own until the client closes it, it never responds to
+// /never.
+class test_server
+{
+public:
+  test_server()
+    : acceptor_(cxt_, *nly::make_tcp_endpoint("127.0.0.1", 0))
+  {
+    thread_ = std::thread(
+      [this]()
+      {
+        while (true)
+        {
+          boost::system::error_code    ec;
+          boost::asio::ip::tcp::socket sock(cxt_);
+          acceptor_.accept(sock, ec);
+          if (ec || stop_)
+          {
+            break;
+          }
+
+          sessions_.emplace_back(
+            [sock = std::move(sock)]() mutable
+            {
+              std::vector<unsigned char> recv_buffer;
+              boost::system::error_code  ec;
+              while (!ec)
+              {
+                nly::beast_http::request<nly::beast_http::string_body> req;
+                nly::beast_http::read(sock, boost::asio::dynamic_buffer(recv_buffer), req, ec);
+                if (!ec && req.target() != "/never")
+                {
+                  nly::beast_http::write(sock, nly::make_response_msg(req.body()), ec);
+                }
+              }
+            });
+        }
+      });
+  }
+
+  ~test_server()
+  {
+    // a blocking accept is only woken up by a connection.
+    stop_ = true;
+    boost::asio::ip::tcp::socket sock(cxt_);
+    sock.connect(acceptor_.local_endpoint());
+    thread_.join();
+    for (auto& item : sessions_)
+    {
+      item.join();
+    }
+  }
+
+  std::vector<boost::asio::ip::tcp::endpoint> endpoints() const
+  {
+    return { acceptor_.local_endpoint() };
+  }
+
+private:
+  boost::asio::io_context        cxt_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  std::atomic<bool>              stop_{ false };
+  std::thread                    thread_;
+  std::vector<std::thread>       sessions_;
+};
+
+typedef nly::beast_http::response<nly::beast_http::string_body> response_type;
+} // namespace
+
+TEST(AsyncHttpClient, ManyInFlight)
+{
+  test_server server;
+
+  boost::asio::io_context  cxt;
+  auto                     guard = boost::asio::make_work_guard(cxt);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 2; ++i)
+  {
+    threads.emplace_back([&cxt]() { cxt.run(); });
+  }
+
+  nly::async_http_client client(cxt);
+  const int              count = 64;
+  std::atomic<int>       success{ 0 };
+  std::atomic<int>       done{ 0 };
+  std::promise<void>     all_done;
+
+  for (int i = 0; i < count; ++i)
+  {
+    client.async_deal_command(
+      server.endpoints(),
+      nly::make_request_msg(nly::beast_http::verb::post, "/echo", std::to_string(i)),
+      std::chrono::milliseconds(5000),
+      [&, i](boost::system::error_code ec, response_type rep)
+      {
+        success += !ec && rep.body() == std::to_string(i);
+        if (++done == count)
+        {
+          all_done.set_value();
+        }
+      });
+  }
+  EXPECT_EQ(all_done.get_future().wait_for(std::chrono::seconds(10)), std::future_status::ready);
+  EXPECT_EQ(success, count);
+
+  // a future instead of a callback.
+  auto future = client.async_deal_command(
+    server.endpoints(),
+    nly::make_request_msg(nly::beast_http::verb::post, "/echo", "future"),
+    std::chrono::milliseconds(5000),
+    boost::asio::use_future);
+  EXPECT_EQ(future.get().body(), "future");
+
+  guard.reset();
+  for (auto& item : threads)
+  {
+    item.join();
+  }
+}
+
+TEST(AsyncHttpClient, DeadlineAndCancel)
+{
+  test_server server;
+
+  boost::asio::io_context cxt;
+  auto                    guard = boost::asio::make_work_guard(cxt);
+  std::thread             thd([&cxt]() { cxt.run(); });
+
+  nly::async_http_client client(cxt);
+  auto req = nly::make_request_msg(nly::beast_http::verb::get, "/never");
+
+  auto start_time = nly::now();
+  auto future = client.async_deal_command(
+    server.endpoints(),
+    req,
+    std::chrono::milliseconds(50),
+    boost::asio::use_future);
+  try
+  {
+    future.get();
+    ADD_FAILURE();
+  }
+  catch (const boost::system::system_error& e)
+  {
+    EXPECT_EQ(e.code(), boost::asio::error::timed_out);
+  }
+  EXPECT_GE(nly::time_diff_ms(start_time), 50);
+
+  // a completed request doesn't stay registered to the cancellation.
+  auto cancellation = std::make_shared<nly::http_cancellation>();
+  for (int i = 0; i < 3; ++i)
+  {
+    future = client.async_deal_command(
+      server.endpoints(),
+      nly::make_request_msg(nly::beast_http::verb::post, "/echo", "echo"),
+      std::chrono::milliseconds(5000),
+      cancellation,
+      boost::asio::use_future);
+    EXPECT_EQ(future.get().body(), "echo");
+  }
+  EXPECT_EQ(cancellation->pending_count(), 0);
+
+  std::promise<boost::system::error_code> result;
+  for (int i = 0; i < 2; ++i)
+  {
+    client.async_deal_command(
+      server.endpoints(),
+      req,
+      std::chrono::milliseconds(5000),
+      cancellation,
+      [&result, i](boost::system::error_code ec, response_type)
+      {
+        if (i)
+        {
+          result.set_value(ec);
+        }
+      });
+  }
+
+  start_time = nly::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(cancellation->pending_count(), 2);
+  cancellation->cancel();
+  EXPECT_EQ(result.get_future().get(), boost::asio::error::operation_aborted);
+  EXPECT_LT(nly::time_diff_ms(start_time), 1000);
+
+  // cancelled before it started.
+  future = client.async_deal_command(
+    server.endpoints(),
+    req,
+    std::chrono::milliseconds(5000),
+    cancellation,
+    boost::asio::use_future);
+  EXPECT_THROW(future.get(), boost::system::system_error);
+
+  guard.reset();
+  thd.join();
+}
@@ -0,0 +1,191 @@
+#include "gtest/gtest.h"
+#include "nly/dns_cache.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST(DnsCache, Cache)
+{
+  std::atomic<int>  resolve_count{ 0 };
+  std::atomic<bool> fail{ false };
+
+  nly::dns_cache cache(
+    std::chrono::milliseconds(100),
+    std::chrono::milliseconds(50),
+    std::chrono::milliseconds(0),
+    [&resolve_count, &fail](const std::string& host, const std::string& service, auto)
+    {
+      ++resolve_count;
+      if (fail || host == "bad")
+      {
+        return nly::dns_cache::endpoints_type();
+      }
+      return nly::dns_cache::endpoints_type{
+        *nly::make_tcp_endpoint("127.0.0.1", std::stoi(service)) };
+    });
+
+  auto endpoints = cache.resolve("good", "80");
+  ASSERT_EQ(endpoints.size(), 1);
+  EXPECT_EQ(endpoints[0].port(), 80);
+  EXPECT_EQ(cache.resolve("good", "80"), endpoints);
+  EXPECT_EQ(cache.resolve("good", "81")[0].port(), 81);
+  EXPECT_EQ(resolve_count, 2);
+
+  // negative caching.
+  EXPECT_TRUE(cache.resolve("bad").empty());
+  EXPECT_TRUE(cache.resolve("bad").empty());
+  EXPECT_EQ(resolve_count, 3);
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  EXPECT_TRUE(cache.resolve("bad").empty());
+  EXPECT_EQ(resolve_count, 4);
+
+  // expired, and the resolver fails: the stale endpoints are used.
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  fail = true;
+  EXPECT_EQ(cache.resolve("good", "80"), endpoints);
+  EXPECT_EQ(resolve_count, 5);
+  EXPECT_EQ(cache.resolve("good", "80"), endpoints);
+  EXPECT_EQ(resolve_count, 5);
+
+  cache.clear();
+  EXPECT_TRUE(cache.resolve("good", "80").empty());
+}
+
+TEST(DnsCache, HttpClient)
+{
+  std::atomic<int> resolve_count{ 0 };
+  nly::dns_cache   cache(
+    std::chrono::milliseconds(60000),
+    std::chrono::milliseconds(5000),
+    std::chrono::milliseconds(0),
+    [&resolve_count](const std::string&, const std::string& service, auto)
+    {
+      ++resolve_count;
+      return nly::dns_cache::endpoints_type{
+        *nly::make_tcp_endpoint("127.0.0.1", std::stoi(service)) };
+    });
+
+  nly::http_client client;
+  client.set_resolver(cache.resolver());
+  for (int i = 0; i < 3; ++i)
+  {
+    EXPECT_TRUE(client.set_host("good", "80"));
+    ASSERT_EQ(client.get_endpoints().size(), 1);
+    EXPECT_EQ(client.get_endpoints()[0].port(), 80);
+  }
+  EXPECT_EQ(resolve_count, 1);
+
+  nly::http_client other;
+  other.set_resolver(cache.resolver());
+  EXPECT_TRUE(other.set_host("good", "80"));
+  EXPECT_TRUE(other.set_host("good", "81"));
+  EXPECT_EQ(resolve_count, 2);
+}
+
+TEST(DnsCache, Refresh)
+{
+  std::atomic<int> resolve_count{ 0 };
+
+  // every lookup more than 50 ms after a resolution triggers a refresh.
+  nly::dns_cache cache(
+    std::chrono::milliseconds(1000),
+    std::chrono::milliseconds(1000),
+    std::chrono::milliseconds(950),
+    [&resolve_count](const std::string&, const std::string&, auto)
+    {
+      ++resolve_count;
+      return nly::dns_cache::endpoints_type{ *nly::make_tcp_endpoint("127.0.0.1", 80) };
+    });
+
+  EXPECT_EQ(cache.resolve("host").size(), 1);
+  EXPECT_EQ(cache.refresh_count(), 0);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  EXPECT_EQ(cache.resolve("host").size(), 1);
+  for (int i = 0; i < 100 && !cache.refresh_count(); ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(cache.refresh_count(), 1);
+  EXPECT_EQ(resolve_count, 2);
+
+  // the refreshed entry is fresh again.
+  EXPECT_EQ(cache.resolve("host").size(), 1);
+  EXPECT_EQ(resolve_count, 2);
+}
+
+TEST(DnsCache, MultiThread)
+{
+  std::atomic<int> resolve_count{ 0 };
+  nly::dns_cache   cache(
+    std::chrono::milliseconds(60000),
+    std::chrono::milliseconds(5000),
+    std::chrono::milliseconds(0),
+    [&resolve_count](const std::string&, const std::string& service, auto)
+    {
+      ++resolve_count;
+      return nly::dns_cache::endpoints_type{
+        *nly::make_tcp_endpoint("127.0.0.1", std::stoi(service)) };
+    });
+
+  std::vector<std::thread> threads;
+  std::atomic<int>         success{ 0 };
+  for (int i = 0; i < 4; ++i)
+  {
+    threads.emplace_back(
+      [&cache, &success]()
+      {
+        for (int j = 0; j < 1000; ++j)
+        {
+          auto service = std::to_string(j % 10 + 1);
+          auto endpoints = cache.resolve("host", service);
+          success += endpoints.size() == 1 && endpoints[0].port() == j % 10 + 1;
+        }
+      });
+  }
+  for (auto& item : threads)
+  {
+    item.join();
+  }
+  EXPECT_EQ(success, 4 * 1000);
+  EXPECT_LE(resolve_count, 4 * 10);
+}
+
+TEST(DnsCache, SingleResolution)
+{
+  std::atomic<int> resolve_count{ 0 };
+  nly::dns_cache   cache(
+    std::chrono::milliseconds(100),
+    std::chrono::milliseconds(100),
+    std::chrono::milliseconds(0),
+    [&resolve_count](const std::string&, const std::string&, auto)
+    {
+      ++resolve_count;
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      return nly::dns_cache::endpoints_type{ *nly::make_tcp_endpoint("127.0.0.1", 80) };
+    });
+
+  auto resolve_together = [&cache]()
+  {
+    std::vector<std::thread> threads;
+    std::atomic<int>         success{ 0 };
+    for (int i = 0; i < 8; ++i)
+    {
+      threads.emplace_back([&cache, &success]() { success += cache.resolve("host").size() == 1; });
+    }
+    for (auto& item : threads)
+    {
+      item.join();
+    }
+    return success.load();
+  };
+
+  // unknown, the other threads wait for the resolution.
+  EXPECT_EQ(resolve_together(), 8);
+  EXPECT_EQ(resolve_count, 1);
+
+  // expired, the other threads get the stale endpoints.
+  std::this_thread::sleep_for(std::chrono::milliseconds(110));
+  EXPECT_EQ(resolve_together(), 8);
+  EXPECT_EQ(resolve_count, 2);
+}
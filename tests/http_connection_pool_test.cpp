@@ -0,0 +1,204 @@
+#include "gtest/gtest.h"
+#include "nly/http_connection_pool.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+// Serves every connection on a thread of its own until the client closes it, /close responds
+// without keep-alive and closes the connection.
+class test_server
+{
+public:
+  test_server()
+    : acceptor_(cxt_, *nly::make_tcp_endpoint("127.0.0.1", 0))
+  {
+    thread_ = std::thread(
+      [this]()
+      {
+        while (true)
+        {
+          boost::system::error_code    ec;
+          boost::asio::ip::tcp::socket sock(cxt_);
+          acceptor_.accept(sock, ec);
+          if (ec || stop_)
+          {
+            break;
+          }
+
+          ++accept_count;
+          sessions_.emplace_back(
+            [sock = std::move(sock)]() mutable
+            {
+              std::vector<unsigned char> recv_buffer;
+              boost::system::error_code  ec;
+              while (true)
+              {
+                nly::beast_http::request<nly::beast_http::string_body> req;
+                nly::beast_http::read(sock, boost::asio::dynamic_buffer(recv_buffer), req, ec);
+                if (ec)
+                {
+                  break;
+                }
+
+                auto res = nly::make_response_msg(std::string(req.target()));
+                res.keep_alive(req.target() != "/close");
+                nly::beast_http::write(sock, res, ec);
+                if (ec || !res.keep_alive())
+                {
+                  break;
+                }
+              }
+            });
+        }
+      });
+  }
+
+  ~test_server()
+  {
+    // a blocking accept is only woken up by a connection.
+    stop_ = true;
+    boost::asio::ip::tcp::socket sock(cxt_);
+    sock.connect(acceptor_.local_endpoint());
+    thread_.join();
+    for (auto& item : sessions_)
+    {
+      item.join();
+    }
+  }
+
+  std::string service() const
+  {
+    return std::to_string(acceptor_.local_endpoint().port());
+  }
+
+  // connections are established before they are accepted.
+  int wait_accept(int count)
+  {
+    for (int i = 0; i < 100 && accept_count < count; ++i)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return accept_count;
+  }
+
+  std::atomic<int> accept_count{ 0 };
+
+private:
+  boost::asio::io_context        cxt_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  std::atomic<bool>              stop_{ false };
+  std::thread                    thread_;
+  std::vector<std::thread>       sessions_;
+};
+} // namespace
+
+TEST(HttpConnectionPool, Reuse)
+{
+  test_server server;
+  {
+    nly::http_connection_pool pool;
+
+    auto req = nly::make_request_msg(nly::beast_http::verb::get, "/hello");
+    for (int i = 0; i < 5; ++i)
+    {
+      auto res = pool.deal_command("127.0.0.1", server.service(), req);
+      ASSERT_TRUE(res);
+      EXPECT_EQ(res->body(), "/hello");
+    }
+    EXPECT_EQ(server.accept_count, 1);
+    EXPECT_EQ(pool.idle_count(), 1);
+
+    // a response without keep-alive drops the connection.
+    req = nly::make_request_msg(nly::beast_http::verb::get, "/close");
+    EXPECT_TRUE(pool.deal_command("127.0.0.1", server.service(), req));
+    EXPECT_EQ(pool.idle_count(), 0);
+
+    req = nly::make_request_msg(nly::beast_http::verb::get, "/hello");
+    EXPECT_TRUE(pool.deal_command("127.0.0.1", server.service(), req));
+    EXPECT_EQ(server.accept_count, 2);
+
+    // the connection is closed by the server behind the back of the pool.
+    {
+      auto conn = pool.acquire("127.0.0.1", server.service());
+      ASSERT_TRUE(conn);
+      EXPECT_TRUE(conn.reused());
+      auto close_req = nly::make_request_msg(nly::beast_http::verb::get, "/close");
+      EXPECT_TRUE(conn->deal_command(close_req));
+    }
+    EXPECT_EQ(pool.idle_count(), 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    auto res = pool.deal_command("127.0.0.1", server.service(), req);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->body(), "/hello");
+    EXPECT_EQ(server.accept_count, 3);
+
+    pool.clear();
+    EXPECT_EQ(pool.idle_count(), 0);
+  }
+}
+
+TEST(HttpConnectionPool, Limit)
+{
+  test_server server;
+  {
+    nly::http_connection_pool pool(2, std::chrono::milliseconds(50));
+
+    auto a = pool.acquire("127.0.0.1", server.service());
+    auto b = pool.acquire("127.0.0.1", server.service());
+    EXPECT_TRUE(a && b);
+    EXPECT_FALSE(pool.acquire("127.0.0.1", server.service(), std::chrono::milliseconds(50)));
+
+    std::thread thd(
+      [&a]()
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        a = {};
+      });
+    auto c = pool.acquire("127.0.0.1", server.service());
+    EXPECT_TRUE(c);
+    EXPECT_TRUE(c.reused());
+    thd.join();
+
+    // idle connections expire.
+    b = {};
+    c = {};
+    EXPECT_EQ(pool.idle_count(), 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto d = pool.acquire("127.0.0.1", server.service());
+    EXPECT_TRUE(d);
+    EXPECT_FALSE(d.reused());
+    EXPECT_EQ(server.wait_accept(3), 3);
+  }
+}
+
+TEST(HttpConnectionPool, MultiThread)
+{
+  test_server server;
+  {
+    nly::http_connection_pool pool(4);
+    std::vector<std::thread>  threads;
+    std::atomic<int>          success{ 0 };
+    for (int i = 0; i < 8; ++i)
+    {
+      threads.emplace_back(
+        [&pool, &server, &success, i]()
+        {
+          auto req = nly::make_request_msg(nly::beast_http::verb::get, "/" + std::to_string(i));
+          for (int j = 0; j < 20; ++j)
+          {
+            auto res = pool.deal_command("127.0.0.1", server.service(), req);
+            success += res && res->body() == "/" + std::to_string(i);
+          }
+        });
+    }
+    for (auto& item : threads)
+    {
+      item.join();
+    }
+    EXPECT_EQ(success, 8 * 20);
+    EXPECT_LE(server.accept_count, 4);
+  }
+}
@@ -0,0 +1,324 @@
+#include "gtest/gtest.h"
+#include "nly/http_server.hpp"
+#include <thread>
+#include <iostream>
+
+namespace
+{
+
+nly::http_server::options test_options(size_t thread_count = 2)
+{
+  nly::http_server::options opt;
+  opt.thread_count = thread_count;
+  return opt;
+}
+
+bool start(nly::http_server& server)
+{
+  return server.start(*nly::make_tcp_endpoint("127.0.0.1", 0));
+}
+
+} // namespace
+
+TEST(HttpServer, Route)
+{
+  nly::http_server server(test_options());
+  server.route(
+    nly::beast_http::verb::get,
+    "/hello",
+    [](const nly::http_server::request_type&) { return nly::make_response_msg("hello"); });
+  server.route(
+    nly::beast_http::verb::post,
+    "/echo",
+    [](const nly::http_server::request_type& req) { return nly::make_response_msg(req.body()); });
+  server.route(
+    nly::beast_http::verb::get,
+    "/close",
+    [](const nly::http_server::request_type&)
+    {
+      auto rep = nly::make_response_msg("bye");
+      rep.keep_alive(false);
+      return rep;
+    });
+  server.route(
+    nly::beast_http::verb::get,
+    "/throw",
+    [](const nly::http_server::request_type&) -> nly::http_server::response_type
+    { throw std::runtime_error("oops"); });
+  ASSERT_TRUE(start(server));
+  EXPECT_FALSE(start(server));
+
+  nly::http_client client;
+  EXPECT_TRUE(client.set_host(server.local_endpoint()));
+  EXPECT_TRUE(client.connect());
+
+  // every request goes over the same connection.
+  for (int i = 0; i < 3; ++i)
+  {
+    auto rep =
+      client.deal_command(nly::make_request_msg(nly::beast_http::verb::get, "/hello?i=1"));
+    ASSERT_TRUE(rep);
+    EXPECT_EQ(rep->result(), nly::beast_http::status::ok);
+    EXPECT_EQ(rep->body(), "hello");
+    EXPECT_TRUE(rep->keep_alive());
+  }
+  EXPECT_EQ(server.connection_count(), 1);
+
+  auto rep = client.deal_command(
+    nly::make_request_msg(nly::beast_http::verb::post, "/echo", "bad world"));
+  ASSERT_TRUE(rep);
+  EXPECT_EQ(rep->body(), "bad world");
+
+  rep = client.deal_command(nly::make_request_msg(nly::beast_http::verb::get, "/missing"));
+  ASSERT_TRUE(rep);
+  EXPECT_EQ(rep->result(), nly::beast_http::status::not_found);
+
+  rep = client.deal_command(nly::make_request_msg(nly::beast_http::verb::get, "/echo"));
+  ASSERT_TRUE(rep);
+  EXPECT_EQ(rep->result(), nly::beast_http::status::method_not_allowed);
+
+  rep = client.deal_command(nly::make_request_msg(nly::beast_http::verb::get, "/throw"));
+  ASSERT_TRUE(rep);
+  EXPECT_EQ(rep->result(), nly::beast_http::status::internal_server_error);
+
+  // the connection is closed if the handler asks so.
+  rep = client.deal_command(nly::make_request_msg(nly::beast_http::verb::get, "/close"));
+  ASSERT_TRUE(rep);
+  EXPECT_FALSE(rep->keep_alive());
+  EXPECT_FALSE(client.deal_command(nly::make_request_msg(nly::beast_http::verb::get, "/hello")));
+  client.close();
+  EXPECT_TRUE(client.connect());
+
+  // or if the client does.
+  auto req = nly::make_request_msg(nly::beast_http::verb::get, "/hello");
+  req.keep_alive(false);
+  rep = client.deal_command(req);
+  ASSERT_TRUE(rep);
+  EXPECT_FALSE(rep->keep_alive());
+  EXPECT_FALSE(client.deal_command(req));
+}
+
+TEST(HttpServer, Async)
+{
+  nly::http_server server(test_options());
+  std::vector<std::thread> workers;
+  server.route_async(
+    nly::beast_http::verb::get,
+    "/later",
+    [&workers](nly::http_server::request_type& req, nly::http_server::responder_type respond)
+    {
+      workers.emplace_back(
+        [respond, target = std::string(req.target())]()
+        {
+          std::this_thread::sleep_for(std::chrono::milliseconds(20));
+          respond(nly::make_response_msg(target));
+          respond(nly::make_response_msg("ignored"));
+        });
+    });
+  ASSERT_TRUE(start(server));
+
+  nly::http_client client;
+  EXPECT_TRUE(client.set_host(server.local_endpoint()));
+  EXPECT_TRUE(client.connect());
+  for (int i = 0; i < 3; ++i)
+  {
+    auto target = "/later?i=" + std::to_string(i);
+    auto rep = client.deal_command(nly::make_request_msg(nly::beast_http::verb::get, target));
+    ASSERT_TRUE(rep);
+    EXPECT_EQ(rep->body(), target);
+  }
+
+  server.stop();
+  for (auto& item : workers)
+  {
+    item.join();
+  }
+}
+
+TEST(HttpServer, ResponderAfterStop)
+{
+  nly::http_server::responder_type kept;
+  {
+    nly::http_server server(test_options(1));
+    server.route_async(
+      nly::beast_http::verb::get,
+      "/never",
+      [&kept](nly::http_server::request_type&, nly::http_server::responder_type respond)
+      { kept = std::move(respond); });
+    ASSERT_TRUE(start(server));
+
+    nly::http_client client;
+    EXPECT_TRUE(client.set_host(server.local_endpoint()));
+    EXPECT_TRUE(client.connect());
+    EXPECT_FALSE(client.deal_command(
+      nly::make_request_msg(nly::beast_http::verb::get, "/never"),
+      std::chrono::milliseconds(200)));
+    EXPECT_EQ(server.connection_count(), 1);
+  }
+
+  // the server and its threads are gone, the responder does nothing and releases the connection.
+  ASSERT_TRUE(kept);
+  kept(nly::make_response_msg("late"));
+  kept = nullptr;
+}
+
+TEST(HttpServer, Pipeline)
+{
+  nly::http_server server(test_options());
+  server.route(
+    nly::beast_http::verb::get,
+    "/echo",
+    [](const nly::http_server::request_type& req)
+    { return nly::make_response_msg(std::string(req.target())); });
+  ASSERT_TRUE(start(server));
+
+  nly::http_client client;
+  EXPECT_TRUE(client.set_host(server.local_endpoint()));
+  EXPECT_TRUE(client.connect());
+
+  std::vector<nly::beast_http::request<nly::beast_http::string_body>> reqs;
+  for (int i = 0; i < 50; ++i)
+  {
+    reqs.emplace_back(
+      nly::make_request_msg(nly::beast_http::verb::get, "/echo?i=" + std::to_string(i)));
+  }
+
+  auto reps = client.deal_commands(reqs);
+  ASSERT_EQ(reps.size(), reqs.size());
+  for (size_t i = 0; i < reps.size(); ++i)
+  {
+    ASSERT_TRUE(reps[i]);
+    EXPECT_EQ(reps[i]->body(), reqs[i].target());
+  }
+  EXPECT_TRUE(client.is_pipelining());
+}
+
+TEST(HttpServer, Limits)
+{
+  auto opt = test_options(1);
+  opt.max_body_byte = 16;
+  opt.max_connection = 1;
+  opt.idle_timeout = std::chrono::milliseconds(200);
+
+  nly::http_server server(opt);
+  server.route(
+    nly::beast_http::verb::post,
+    "/echo",
+    [](const nly::http_server::request_type& req) { return nly::make_response_msg(req.body()); });
+  ASSERT_TRUE(start(server));
+
+  nly::http_client client;
+  EXPECT_TRUE(client.set_host(server.local_endpoint()));
+  EXPECT_TRUE(client.connect());
+
+  auto rep = client.deal_command(
+    nly::make_request_msg(nly::beast_http::verb::post, "/echo", std::string(17, 'x')));
+  ASSERT_TRUE(rep);
+  EXPECT_EQ(rep->result(), nly::beast_http::status::payload_too_large);
+  EXPECT_FALSE(rep->keep_alive());
+  client.close();
+
+  // the connection limit.
+  EXPECT_TRUE(client.connect());
+  auto small = nly::make_request_msg(nly::beast_http::verb::post, "/echo", "small");
+  EXPECT_TRUE(client.deal_command(small));
+
+  nly::http_client other;
+  EXPECT_TRUE(other.set_host(server.local_endpoint()));
+  EXPECT_TRUE(other.connect());
+  EXPECT_FALSE(other.deal_command(small, std::chrono::milliseconds(1000)));
+
+  // idle connections are closed.
+  std::this_thread::sleep_for(std::chrono::milliseconds(400));
+  EXPECT_EQ(server.connection_count(), 0);
+  EXPECT_FALSE(client.deal_command(small));
+
+  EXPECT_TRUE(other.connect());
+  EXPECT_TRUE(other.deal_command(small));
+}
+
+TEST(HttpServer, SlowBody)
+{
+  auto opt = test_options(1);
+  opt.idle_timeout = std::chrono::milliseconds(200);
+  opt.body_timeout = std::chrono::milliseconds(600);
+
+  nly::http_server server(opt);
+  server.route(
+    nly::beast_http::verb::post,
+    "/echo",
+    [](const nly::http_server::request_type& req) { return nly::make_response_msg(req.body()); });
+  ASSERT_TRUE(start(server));
+
+  boost::asio::io_context      cxt;
+  boost::asio::ip::tcp::socket sock(cxt);
+  sock.connect(server.local_endpoint());
+
+  // the body arrives after the idle timeout, but within the body timeout.
+  std::string header = "POST /echo HTTP/1.1\r\nHost: test\r\nContent-Length: 5\r\n\r\n";
+  boost::asio::write(sock, boost::asio::buffer(header));
+  std::this_thread::sleep_for(std::chrono::milliseconds(350));
+  boost::asio::write(sock, boost::asio::buffer(std::string("hello")));
+
+  boost::beast::flat_buffer                               buffer;
+  nly::beast_http::response<nly::beast_http::string_body> rep;
+  boost::system::error_code                               ec;
+  nly::beast_http::read(sock, buffer, rep, ec);
+  ASSERT_FALSE(ec);
+  EXPECT_EQ(rep.body(), "hello");
+
+  // a body which doesn't come in time.
+  boost::asio::write(sock, boost::asio::buffer(header));
+  std::this_thread::sleep_for(std::chrono::milliseconds(800));
+  nly::beast_http::read(sock, buffer, rep, ec);
+  EXPECT_TRUE(ec);
+  EXPECT_EQ(server.connection_count(), 0);
+}
+
+TEST(HttpServer, Throughput)
+{
+  nly::http_server server;
+  server.route(
+    nly::beast_http::verb::get,
+    "/",
+    [](const nly::http_server::request_type&) { return nly::make_response_msg("hello"); });
+  ASSERT_TRUE(start(server));
+
+  const size_t thread_count = 4;
+  const size_t batch = 100;
+  const auto   duration = std::chrono::milliseconds(500);
+
+  std::atomic<size_t>      count{ 0 };
+  std::vector<std::thread> threads;
+  auto                     start_time = nly::now();
+  for (size_t i = 0; i < thread_count; ++i)
+  {
+    threads.emplace_back(
+      [&]()
+      {
+        nly::http_client client;
+        client.set_host(server.local_endpoint());
+        client.connect();
+
+        std::vector<nly::beast_http::request<nly::beast_http::string_body>> reqs(
+          batch,
+          nly::make_request_msg(nly::beast_http::verb::get, "/"));
+        while (nly::now() - start_time < duration)
+        {
+          for (auto& item : client.deal_commands(reqs))
+          {
+            count += item ? 1 : 0;
+          }
+        }
+      });
+  }
+
+  for (auto& item : threads)
+  {
+    item.join();
+  }
+
+  auto ms = nly::time_diff_ms(start_time);
+  std::cout << "http_server: " << count * 1000 / (std::max)(ms, 1ll) << " req/s" << std::endl;
+  EXPECT_GT(count, 0);
+}
@@ -0,0 +1,72 @@
+#include "gtest/gtest.h"
+#include "nly/http_timing.hpp"
+#include <thread>
+
+TEST(HttpTiming, Phases)
+{
+  nly::http_timing timing;
+  EXPECT_EQ(timing.resolve_us(), -1);
+  EXPECT_EQ(timing.total_us(), -1);
+
+  auto start = nly::now();
+  timing.connect_start = start;
+  timing.connect_end = start + std::chrono::microseconds(100);
+  timing.write_start = start + std::chrono::microseconds(150);
+  timing.write_end = start + std::chrono::microseconds(200);
+  timing.header_end = start + std::chrono::microseconds(1200);
+  EXPECT_EQ(timing.resolve_us(), -1);
+  EXPECT_EQ(timing.connect_us(), 100);
+  EXPECT_EQ(timing.write_us(), 50);
+  EXPECT_EQ(timing.ttfb_us(), 1000);
+
+  // the body wasn't read.
+  EXPECT_EQ(timing.body_us(), -1);
+  EXPECT_EQ(timing.total_us(), -1);
+
+  timing.body_end = start + std::chrono::microseconds(1500);
+  EXPECT_EQ(timing.body_us(), 300);
+  EXPECT_EQ(timing.total_us(), 1500);
+}
+
+TEST(HttpTiming, Stats)
+{
+  nly::http_timing_stats stats;
+  EXPECT_FALSE(stats.get("a:80"));
+
+  auto             start = nly::now();
+  nly::http_timing timing;
+  timing.write_start = start;
+  timing.write_end = start + std::chrono::microseconds(10);
+  timing.header_end = start + std::chrono::microseconds(110);
+  timing.body_end = start + std::chrono::microseconds(120);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i)
+  {
+    threads.emplace_back(
+      [&stats, &timing]()
+      {
+        for (int j = 0; j < 100; ++j)
+        {
+          stats.record("a:80", timing);
+        }
+      });
+  }
+  for (auto& item : threads)
+  {
+    item.join();
+  }
+  stats.record("b:80", timing);
+
+  auto a = stats.get("a:80");
+  ASSERT_TRUE(a);
+  EXPECT_EQ(a->total.count(), 400);
+  EXPECT_EQ(a->resolve.count(), 0);
+  EXPECT_EQ(a->connect.count(), 0);
+  EXPECT_EQ(a->ttfb.percentile(50), 100);
+  EXPECT_EQ(a->total.percentile(99), 120);
+  EXPECT_EQ(stats.hosts(), (std::vector<std::string>{ "a:80", "b:80" }));
+
+  stats.clear();
+  EXPECT_TRUE(stats.hosts().empty());
+}
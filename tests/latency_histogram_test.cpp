@@ -0,0 +1,79 @@
+#include "gtest/gtest.h"
+#include "nly/latency_histogram.hpp"
+
+TEST(LatencyHistogram, Percentile)
+{
+  nly::latency_histogram histogram;
+  EXPECT_EQ(histogram.count(), 0);
+  EXPECT_EQ(histogram.percentile(50), 0);
+
+  for (std::uint64_t i = 1; i <= 10000; ++i)
+  {
+    histogram.record(i);
+  }
+  EXPECT_EQ(histogram.count(), 10000);
+  EXPECT_EQ(histogram.min(), 1);
+  EXPECT_EQ(histogram.max(), 10000);
+  EXPECT_DOUBLE_EQ(histogram.mean(), 5000.5);
+
+  // 3 significant digits.
+  EXPECT_NEAR(histogram.percentile(50), 5000, 5);
+  EXPECT_NEAR(histogram.percentile(99), 9900, 10);
+  EXPECT_NEAR(histogram.percentile(99.9), 9990, 10);
+  EXPECT_EQ(histogram.percentile(100), 10000);
+  EXPECT_EQ(histogram.percentile(0), 1);
+
+  // exact below 2048.
+  nly::latency_histogram small;
+  small.record(7, 3);
+  small.record(2047);
+  EXPECT_EQ(small.percentile(75), 7);
+  EXPECT_EQ(small.percentile(76), 2047);
+
+  // large values keep their precision, and are clamped to the highest value.
+  nly::latency_histogram large(1000000000);
+  large.record(123456789);
+  EXPECT_NEAR(large.percentile(50), 123456789, 123456789 / 1000);
+  large.record(5000000000ull);
+  EXPECT_EQ(large.max(), 1000000000);
+}
+
+TEST(LatencyHistogram, Corrected)
+{
+  nly::latency_histogram histogram;
+  histogram.record_corrected(1000, 100);
+  EXPECT_EQ(histogram.count(), 10);
+  EXPECT_EQ(histogram.min(), 100);
+  EXPECT_EQ(histogram.max(), 1000);
+
+  histogram.reset();
+  histogram.record_corrected(1000, 0);
+  EXPECT_EQ(histogram.count(), 1);
+
+  // corrected after recording.
+  auto corrected = histogram.corrected(100);
+  EXPECT_EQ(corrected.count(), 10);
+  EXPECT_EQ(corrected.min(), 100);
+  EXPECT_EQ(corrected.max(), 1000);
+  EXPECT_EQ(histogram.count(), 1);
+  EXPECT_EQ(histogram.corrected(0).count(), 1);
+}
+
+TEST(LatencyHistogram, Merge)
+{
+  nly::latency_histogram a;
+  nly::latency_histogram b;
+  a.record(10);
+  b.record(20, 2);
+  a.merge(b);
+  EXPECT_EQ(a.count(), 3);
+  EXPECT_EQ(a.min(), 10);
+  EXPECT_EQ(a.max(), 20);
+  EXPECT_EQ(a.percentile(50), 20);
+
+  // different layouts are not merged.
+  nly::latency_histogram other(1000, 2);
+  other.record(5);
+  a.merge(other);
+  EXPECT_EQ(a.count(), 3);
+}
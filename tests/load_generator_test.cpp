@@ -0,0 +1,152 @@
+#include "gtest/gtest.h"
+#include "nly/load_generator.hpp"
+#include "nly/http_server.hpp"
+#include <thread>
+#include <iostream>
+
+namespace
+{
+
+std::string start(nly::http_server& server)
+{
+  server.route(
+    nly::beast_http::verb::get,
+    "/",
+    [](const nly::http_server::request_type&) { return nly::make_response_msg("hello"); });
+  server.route(
+    nly::beast_http::verb::get,
+    "/missing",
+    [](const nly::http_server::request_type&)
+    { return nly::make_response_msg("", nly::beast_http::status::not_found); });
+  if (!server.start(*nly::make_tcp_endpoint("127.0.0.1", 0)))
+  {
+    return {};
+  }
+  return "http://127.0.0.1:" + std::to_string(server.local_endpoint().port());
+}
+
+} // namespace
+
+TEST(LoadGenerator, ParseUrl)
+{
+  auto url = nly::load_generator::parse_url("http://example.com:8080/a/b?c=1");
+  ASSERT_TRUE(url);
+  EXPECT_EQ(url->host, "example.com");
+  EXPECT_EQ(url->service, "8080");
+  EXPECT_EQ(url->target, "/a/b?c=1");
+
+  url = nly::load_generator::parse_url("http://example.com");
+  ASSERT_TRUE(url);
+  EXPECT_EQ(url->service, "http");
+  EXPECT_EQ(url->target, "/");
+
+  url = nly::load_generator::parse_url("http://[::1]:80/");
+  ASSERT_TRUE(url);
+  EXPECT_EQ(url->host, "::1");
+  EXPECT_EQ(url->service, "80");
+
+  EXPECT_FALSE(nly::load_generator::parse_url("https://example.com"));
+  EXPECT_FALSE(nly::load_generator::parse_url("http://:80/"));
+}
+
+TEST(LoadGenerator, ClosedLoop)
+{
+  nly::http_server server;
+  auto             url = start(server);
+  ASSERT_FALSE(url.empty());
+
+  nly::load_generator::options opt;
+  opt.url = url + "/";
+  opt.connection_count = 2;
+  opt.duration = std::chrono::milliseconds(300);
+
+  auto result = nly::load_generator(opt).run();
+  ASSERT_TRUE(result);
+  EXPECT_GT(result->request_count, 0);
+  EXPECT_EQ(result->error_count, 0);
+  EXPECT_EQ(result->non_2xx_count, 0);
+  EXPECT_EQ(result->uncorrected_latency.count(), result->request_count);
+
+  // corrected with the mean latency by default.
+  EXPECT_GT(result->expected_interval, 0);
+  EXPECT_GE(result->latency.count(), result->request_count);
+  EXPECT_GE(result->latency.max(), result->uncorrected_latency.max());
+  EXPECT_GT(result->throughput(), 0);
+  EXPECT_LE(result->latency.percentile(50), result->latency.percentile(99.9));
+
+  auto json = result->to_json();
+  EXPECT_NE(json.find("\"p999\""), std::string::npos);
+  EXPECT_NE(json.find("\"expected_interval_us\""), std::string::npos);
+  EXPECT_NE(json.find("\"url\": \"" + opt.url + "\""), std::string::npos);
+  std::cout << json;
+
+  opt.url = url + "/missing";
+  result = nly::load_generator(opt).run();
+  ASSERT_TRUE(result);
+  EXPECT_EQ(result->non_2xx_count, result->request_count);
+}
+
+TEST(LoadGenerator, FixedRate)
+{
+  nly::http_server server;
+  auto             url = start(server);
+  ASSERT_FALSE(url.empty());
+
+  nly::load_generator::options opt;
+  opt.url = url;
+  opt.connection_count = 2;
+  opt.rate = 200;
+  opt.duration = std::chrono::milliseconds(500);
+
+  auto result = nly::load_generator(opt).run();
+  ASSERT_TRUE(result);
+  EXPECT_EQ(result->request_count + result->error_count, 100);
+  EXPECT_NEAR(result->throughput(), 200, 40);
+  EXPECT_EQ(result->expected_interval, 10000);
+
+  // the corrected latency runs from the intended send time, never less than the measured one.
+  EXPECT_GE(result->latency.max(), result->uncorrected_latency.max());
+}
+
+TEST(LoadGenerator, Reconnect)
+{
+  nly::http_server server;
+  auto             url = start(server);
+  ASSERT_FALSE(url.empty());
+
+  nly::load_generator::options opt;
+  opt.url = url;
+  opt.duration = std::chrono::milliseconds(500);
+  opt.timeout = std::chrono::milliseconds(200);
+
+  std::thread stopper(
+    [&server]()
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      server.stop();
+    });
+  auto result = nly::load_generator(opt).run();
+  stopper.join();
+
+  // the connection is tried again after 10, 20, 40... ms rather than in a busy loop.
+  ASSERT_TRUE(result);
+  EXPECT_GT(result->request_count, 0);
+  EXPECT_GT(result->error_count, 0);
+  EXPECT_LT(result->error_count, 20);
+}
+
+TEST(LoadGenerator, Unreachable)
+{
+  nly::load_generator::options opt;
+  opt.url = "ftp://127.0.0.1/";
+  EXPECT_FALSE(nly::load_generator(opt).run());
+
+  // a port nothing listens on.
+  nly::http_server server;
+  auto             url = start(server);
+  ASSERT_FALSE(url.empty());
+  server.stop();
+  opt.url = url;
+  opt.timeout = std::chrono::milliseconds(500);
+  EXPECT_FALSE(nly::load_generator(opt).run());
+}
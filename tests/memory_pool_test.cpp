@@ -1,6 +1,51 @@
 #include "gtest/gtest.h"
 #include "nly/memory_pool.hpp"
 #include "nly/time/time_count.hpp"
+#include <set>
+#include <atomic>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// every thread mallocs a burst of nodes and frees them, round times.
+// return: the elapsed time, unit: second
+template<typename t_pool>
+double malloc_free_bursts(t_pool& pool, size_t thread_count, size_t round)
+{
+  auto                     start_time = nly::now();
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < thread_count; ++i)
+  {
+    threads.emplace_back(
+      [&pool, round]()
+      {
+        void* nodes[16];
+        for (size_t j = 0; j < round; ++j)
+        {
+          for (auto& item : nodes)
+          {
+            item = pool.malloc();
+          }
+          for (auto item : nodes)
+          {
+            pool.free(item);
+          }
+        }
+      });
+  }
+
+  for (auto& item : threads)
+  {
+    item.join();
+  }
+  return nly::time_diff(start_time);
+}
+
+} // namespace
 
 TEST(MemoryPool, All)
 {
@@ -28,4 +73,343 @@ TEST(MemoryPool, All)
 
   EXPECT_TRUE(pool.release_all());
   delete[] buff;
-}
\ No newline at end of file
+}
+
+TEST(MemoryPool, ThreadCached)
+{
+  nly::thread_cached_memory_pool pool(64, 8);
+  EXPECT_EQ(pool.node_size(), 64);
+
+  const int                      thread_count = 4;
+  const int                      node_count = 10000;
+  std::vector<std::vector<int*>> nodes(thread_count);
+  std::vector<std::thread>       threads;
+
+  for (int i = 0; i < thread_count; ++i)
+  {
+    threads.emplace_back(
+      [&pool, &nodes, i]()
+      {
+        for (int j = 0; j < node_count; ++j)
+        {
+          auto p = static_cast<int*>(pool.malloc());
+          ASSERT_TRUE(p);
+          *p = i * node_count + j;
+          nodes[i].emplace_back(p);
+
+          if (j % 3 == 0)
+          {
+            pool.free(nodes[i].back());
+            nodes[i].pop_back();
+          }
+        }
+      });
+  }
+  for (auto& item : threads)
+  {
+    item.join();
+  }
+  threads.clear();
+
+  std::set<int*> unique;
+  for (int i = 0; i < thread_count; ++i)
+  {
+    for (auto p : nodes[i])
+    {
+      EXPECT_TRUE(*p / node_count == i);
+      unique.insert(p);
+    }
+  }
+  EXPECT_EQ(unique.size(), thread_count * (node_count - (node_count + 2) / 3));
+
+  // free the nodes on other threads.
+  for (int i = 0; i < thread_count; ++i)
+  {
+    threads.emplace_back(
+      [&pool, &nodes, i]()
+      {
+        for (auto p : nodes[(i + 1) % thread_count])
+        {
+          pool.free(p);
+        }
+      });
+  }
+  for (auto& item : threads)
+  {
+    item.join();
+  }
+
+  auto p = pool.malloc();
+  EXPECT_TRUE(p);
+  pool.free(p);
+  pool.flush();
+
+  // every node is back in the shared pool, the caches of the threads were flushed on exit.
+  EXPECT_TRUE(pool.release_unused());
+}
+
+// A benchmark of the shared pool against the thread cached one, the costs are recorded as test
+// properties. Disabled by default, run it with --gtest_also_run_disabled_tests.
+TEST(MemoryPool, DISABLED_ThreadCachedBenchmark)
+{
+  const size_t round = 20000;
+  for (size_t thread_count : { 1, 2, 4, 8 })
+  {
+    nly::memory_pool_s             shared(64);
+    nly::thread_cached_memory_pool cached(64);
+
+    auto shared_cost_time = malloc_free_bursts(shared, thread_count, round);
+    auto cached_cost_time = malloc_free_bursts(cached, thread_count, round);
+
+    auto suffix = "_" + std::to_string(thread_count) + "_threads_ms";
+    RecordProperty("shared" + suffix, static_cast<int>(shared_cost_time * 1000));
+    RecordProperty("thread_cached" + suffix, static_cast<int>(cached_cost_time * 1000));
+  }
+}
+
+TEST(MemoryPool, Batch)
+{
+  nly::memory_pool_s pool(64, 4);
+
+  void* nodes[256] = {};
+  EXPECT_EQ(pool.malloc_n(256, nodes), 256);
+
+  std::set<void*> unique(std::begin(nodes), std::end(nodes));
+  EXPECT_EQ(unique.size(), 256);
+  EXPECT_TRUE(!unique.count(nullptr));
+
+  pool.free_n(nodes, 256);
+  EXPECT_EQ(pool.malloc_n(256, nodes), 256);
+  EXPECT_EQ(std::set<void*>(std::begin(nodes), std::end(nodes)), unique);
+  pool.free_n(nodes, 256);
+
+  // without reserve the pool would grow 4, 4, 4... nodes at a time.
+  nly::memory_pool<> bounded(64, 4, 4);
+  EXPECT_TRUE(bounded.reserve(1000));
+  EXPECT_TRUE(bounded.reserve(0));
+  EXPECT_EQ(bounded.malloc_n(256, nodes), 256);
+
+  auto range = std::minmax_element(std::begin(nodes), std::end(nodes));
+  EXPECT_TRUE(static_cast<char*>(*range.second) - static_cast<char*>(*range.first) < 1000 * 64);
+
+  // without statistics the nodes are only counted from set_trim_policy on.
+  nly::memory_pool<> uncounted(64, 4);
+  EXPECT_EQ(uncounted.malloc_n(10, nodes), 10);
+  uncounted.free_n(nodes, 3);
+  auto free_node = uncounted.free_node();
+  EXPECT_TRUE(free_node >= 3);
+  uncounted.set_trim_policy(nly::trim_policy());
+  EXPECT_EQ(uncounted.free_node(), free_node);
+  uncounted.free_n(nodes + 3, 7);
+  EXPECT_EQ(uncounted.free_node(), free_node + 7);
+}
+
+TEST(MemoryPool, Stats)
+{
+  nly::memory_pool<std::mutex, true> pool(64, 4);
+
+  auto stats = pool.snapshot();
+  EXPECT_EQ(stats.live_node, 0);
+  EXPECT_EQ(stats.reserved_byte, 0);
+  EXPECT_EQ(stats.growth_count, 0);
+
+  // 4 + 8 nodes are requested from the system.
+  void* nodes[10] = {};
+  for (auto& item : nodes)
+  {
+    item = pool.malloc();
+  }
+  pool.free(nodes[0]);
+  pool.free_n(nodes + 1, 2);
+
+  stats = pool.snapshot();
+  EXPECT_EQ(stats.live_node, 7);
+  EXPECT_EQ(stats.peak_node, 10);
+  EXPECT_EQ(stats.growth_count, 2);
+  EXPECT_TRUE(stats.reserved_byte >= 12 * 64);
+
+  size_t malloc_count = 0;
+  for (auto item : stats.malloc_latency)
+  {
+    malloc_count += item;
+  }
+  EXPECT_EQ(malloc_count, 10);
+
+  EXPECT_EQ(pool.malloc_n(3, nodes), 3);
+  EXPECT_EQ(pool.snapshot().live_node, 10);
+  EXPECT_EQ(pool.snapshot().growth_count, 2);
+
+  EXPECT_TRUE(pool.reserve(100));
+  stats = pool.snapshot();
+  EXPECT_EQ(stats.growth_count, 3);
+  EXPECT_TRUE(stats.reserved_byte >= 112 * 64);
+
+  EXPECT_TRUE(pool.release_all());
+  stats = pool.snapshot();
+  EXPECT_EQ(stats.live_node, 0);
+  EXPECT_EQ(stats.reserved_byte, 0);
+  EXPECT_EQ(stats.peak_node, 10);
+}
+
+TEST(MemoryPool, Trim)
+{
+  nly::memory_pool<std::mutex, true> pool(64, 4, 4);
+
+  // 64 blocks of 4 nodes, free every node of the odd blocks.
+  std::vector<void*> nodes(256);
+  EXPECT_EQ(pool.malloc_n(nodes.size(), nodes.data()), nodes.size());
+  std::sort(nodes.begin(), nodes.end());
+  std::vector<void*> live;
+  for (size_t i = 0; i < nodes.size(); ++i)
+  {
+    if ((i / 4) % 2)
+    {
+      pool.free(nodes[i]);
+    }
+    else
+    {
+      live.emplace_back(nodes[i]);
+    }
+  }
+  EXPECT_EQ(pool.free_node(), 128);
+
+  auto reserved_byte = pool.snapshot().reserved_byte;
+  EXPECT_EQ(pool.trim(128), 0);
+
+  // the first 8 free nodes are kept, the blocks holding them too.
+  auto released_byte = pool.trim(8);
+  EXPECT_TRUE(released_byte > 0);
+  EXPECT_TRUE(pool.free_node() >= 8 && pool.free_node() <= 16);
+  EXPECT_EQ(pool.snapshot().reserved_byte, reserved_byte - released_byte);
+  EXPECT_EQ(pool.snapshot().trimmed_byte, released_byte);
+
+  // the block of the freed node still has allocated nodes.
+  pool.free(live.back());
+  live.pop_back();
+  EXPECT_TRUE(pool.trim(0) > 0);
+  EXPECT_EQ(pool.free_node(), 1);
+  EXPECT_EQ(pool.trim(0), 0);
+
+  EXPECT_EQ(pool.malloc_n(live.size(), nodes.data()), live.size());
+  pool.free_n(live.data(), live.size());
+  pool.free_n(nodes.data(), live.size());
+  EXPECT_TRUE(pool.release_unused());
+  EXPECT_EQ(pool.free_node(), 0);
+  EXPECT_EQ(pool.snapshot().reserved_byte, 0);
+  EXPECT_EQ(pool.snapshot().live_node, 0);
+
+  // more free nodes than a single lock handles, every other block keeps an allocated node.
+  nodes.resize(16384);
+  EXPECT_EQ(pool.malloc_n(nodes.size(), nodes.data()), nodes.size());
+  std::sort(nodes.begin(), nodes.end());
+  live.clear();
+  for (size_t i = 0; i < nodes.size(); ++i)
+  {
+    if (i % 8)
+    {
+      pool.free(nodes[i]);
+    }
+    else
+    {
+      live.emplace_back(nodes[i]);
+    }
+  }
+  reserved_byte = pool.snapshot().reserved_byte;
+  EXPECT_EQ(pool.trim(0), reserved_byte / 2);
+  EXPECT_EQ(pool.free_node(), live.size() * 3);
+  EXPECT_EQ(pool.malloc_n(live.size() * 3, nodes.data()), live.size() * 3);
+  EXPECT_EQ(pool.snapshot().reserved_byte, reserved_byte / 2);
+  pool.free_n(nodes.data(), live.size() * 3);
+  pool.free_n(live.data(), live.size());
+  EXPECT_TRUE(pool.release_unused());
+  EXPECT_EQ(pool.free_node(), 0);
+}
+
+TEST(MemoryPool, TrimRace)
+{
+  nly::memory_pool_s pool(64, 4, 4);
+  nly::trim_policy   policy;
+  policy.decay_time = std::chrono::milliseconds(0);
+  pool.set_trim_policy(policy);
+
+  // trim_step walks the free nodes while release_all frees their blocks.
+  std::atomic<bool> stop{ false };
+  std::thread       trimmer(
+    [&pool, &stop]()
+    {
+      while (!stop)
+      {
+        pool.trim_step();
+      }
+    });
+
+  std::vector<void*> nodes(256);
+  for (int i = 0; i < 2000; ++i)
+  {
+    auto count = pool.malloc_n(nodes.size(), nodes.data());
+    EXPECT_EQ(count, nodes.size());
+    pool.free_n(nodes.data() + count / 2, count - count / 2);
+    if (i % 2)
+    {
+      pool.release_all();
+    }
+    else
+    {
+      pool.free_n(nodes.data(), count / 2);
+    }
+  }
+  stop = true;
+  trimmer.join();
+
+  pool.release_all();
+  EXPECT_EQ(pool.free_node(), 0);
+}
+
+TEST(MemoryPool, TrimPolicy)
+{
+  nly::memory_pool_s pool(64, 4, 4);
+
+  int              crossed = 0;
+  nly::trim_policy policy;
+  policy.low_watermark = 16 * 64;
+  policy.high_watermark = 64 * 64;
+  policy.decay_time = std::chrono::milliseconds(0);
+  policy.on_high_watermark = [&crossed]() { ++crossed; };
+  pool.set_trim_policy(policy);
+
+  std::vector<void*> nodes(256);
+  EXPECT_EQ(pool.malloc_n(nodes.size(), nodes.data()), nodes.size());
+
+  // the free crossing the high watermark doesn't trim, the next step trims down to the low
+  // watermark.
+  pool.free_n(nodes.data(), 64);
+  EXPECT_EQ(pool.free_node(), 64);
+  EXPECT_EQ(crossed, 0);
+  pool.free(nodes[64]);
+  EXPECT_EQ(crossed, 1);
+  EXPECT_EQ(pool.free_node(), 65);
+  EXPECT_TRUE(pool.trim_step() > 0);
+  EXPECT_TRUE(pool.free_node() <= 16 + 4);
+
+  // below the high watermark only trim_step returns memory.
+  pool.free_n(nodes.data() + 65, 40);
+  auto free_node = pool.free_node();
+  EXPECT_TRUE(free_node > 16 + 4);
+  EXPECT_TRUE(pool.trim_step() > 0);
+  EXPECT_TRUE(pool.free_node() <= 16 + 4);
+  EXPECT_EQ(pool.trim_step(), 0);
+
+  // with decay, a step shortly after the previous one returns little or nothing.
+  policy.decay_time = std::chrono::milliseconds(60000);
+  pool.set_trim_policy(policy);
+  pool.free_n(nodes.data() + 105, 40);
+  free_node = pool.free_node();
+  pool.trim_step();
+  EXPECT_TRUE(pool.free_node() + 8 >= free_node);
+
+  // whatever the decay.
+  pool.free_n(nodes.data() + 145, nodes.size() - 145);
+  EXPECT_EQ(crossed, 2);
+  pool.trim_step();
+  EXPECT_TRUE(pool.free_node() <= 16 + 4);
+}
@@ -0,0 +1,120 @@
+#include "gtest/gtest.h"
+#include "nly/memory_resource.hpp"
+#include "nly/memory_stream.hpp"
+#include <map>
+#include <list>
+#include <string>
+#include <vector>
+
+// counts the bytes passed to upstream.
+class counting_resource : public std::pmr::memory_resource
+{
+public:
+  size_t allocated = 0;
+
+protected:
+  void* do_allocate(size_t bytes, size_t alignment) override
+  {
+    allocated += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override
+  {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+  {
+    return this == &other;
+  }
+};
+
+TEST(MemoryResource, MemoryPool)
+{
+  nly::memory_pool<>                            pool(64);
+  counting_resource                             upstream;
+  nly::memory_pool_resource<nly::memory_pool<>> resource(pool, &upstream);
+  EXPECT_EQ(&resource.pool(), &pool);
+
+  // list nodes fit in the pool.
+  std::pmr::list<int> list(&resource);
+  for (int i = 0; i < 1000; ++i)
+  {
+    list.emplace_back(i);
+  }
+  EXPECT_EQ(upstream.allocated, 0);
+  EXPECT_EQ(list.back(), 999);
+
+  // the buffer of a large vector doesn't fit.
+  std::pmr::vector<int> vec(1000, 1, &resource);
+  EXPECT_EQ(upstream.allocated, 1000 * sizeof(int));
+
+  EXPECT_TRUE(resource.is_equal(resource));
+  nly::memory_pool_resource<nly::memory_pool<>> other(pool, &upstream);
+  EXPECT_FALSE(resource.is_equal(other));
+}
+
+TEST(MemoryResource, SizeClassPool)
+{
+  nly::size_class_pool<>     pool(64, 4096);
+  counting_resource          upstream;
+  nly::size_class_resource<> resource(pool, &upstream);
+
+  std::pmr::map<std::pmr::string, std::pmr::vector<char>> map(&resource);
+  for (int i = 0; i < 100; ++i)
+  {
+    map[std::pmr::string(std::to_string(i) + " a key longer than the small string buffer")]
+      .resize(i * 10);
+  }
+  EXPECT_EQ(map.size(), 100);
+  EXPECT_EQ(map.begin()->second.size(), 0);
+  EXPECT_EQ(upstream.allocated, 0);
+
+  // over-aligned memory goes to upstream.
+  auto p = resource.allocate(64, 64);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % 64, 0);
+  EXPECT_EQ(upstream.allocated, 64);
+  resource.deallocate(p, 64, 64);
+}
+
+TEST(MemoryResource, PoolAllocator)
+{
+  nly::size_class_pool_s pool;
+
+  std::vector<int, nly::pool_allocator<int>> vec{ nly::pool_allocator<int>(pool) };
+  for (int i = 0; i < 10000; ++i)
+  {
+    vec.emplace_back(i);
+  }
+  EXPECT_EQ(vec[9999], 9999);
+
+  typedef nly::pool_allocator<std::pair<const int, int>> map_allocator;
+  std::map<int, int, std::less<int>, map_allocator> map{ map_allocator(pool) };
+  for (int i = 0; i < 1000; ++i)
+  {
+    map[i] = i * 2;
+  }
+  EXPECT_EQ(map.at(500), 1000);
+
+  EXPECT_TRUE(vec.get_allocator() == map.get_allocator());
+  nly::size_class_pool_s other;
+  EXPECT_TRUE(vec.get_allocator() != nly::pool_allocator<int>(other));
+}
+
+TEST(MemoryResource, MemoryStream)
+{
+  nly::size_class_pool<>     pool;
+  counting_resource          upstream;
+  nly::size_class_resource<> resource(pool, &upstream);
+
+  unsigned char      data[4] = { 1, 2, 3, 4 };
+  nly::memory_stream ms(nullptr, &resource);
+  for (int i = 0; i < 1000; ++i)
+  {
+    ms.add(data, sizeof data);
+  }
+  EXPECT_EQ(ms.available_byte(), 4000);
+  EXPECT_EQ(ms.find(data + 3, 1), 3);
+  EXPECT_EQ(upstream.allocated, 0);
+}
@@ -1,6 +1,9 @@
 #include "gtest/gtest.h"
 #include "nly/memory_stream.hpp"
+#include "nly/time/time_count.hpp"
+#include "BS_thread_pool.hpp"
 #include <bitset>
+#include <random>
 
 TEST(MemoryStream, BitSetCount)
 {
@@ -162,4 +165,214 @@ TEST(MemoryStream, Left)
 
   EXPECT_EQ(ms.slide(-1), 3);
   EXPECT_EQ(ms.slide(-1), 0);
-}
\ No newline at end of file
+}
+
+TEST(MemoryStream, FindAll)
+{
+  nly::memory_stream ms([](const nly::memory_stream::memory_type& chunk)
+                        { delete[] static_cast<const unsigned char*>(chunk.first); });
+
+  // 01 02 01 | 02 01 | 02
+  unsigned char* buf = new unsigned char[3]{ 0x01, 0x02, 0x01 };
+  ms.add(buf, 3);
+  buf = new unsigned char[2]{ 0x02, 0x01 };
+  ms.add(buf, 2);
+  buf = new unsigned char[1]{ 0x02 };
+  ms.add(buf, 1);
+
+  unsigned char target[] = { 0x01, 0x02, 0x01 };
+  EXPECT_EQ(ms.find_all(target, 0), std::vector<size_t>{});
+  EXPECT_EQ(ms.find_all(target, 1), (std::vector<size_t>{ 0, 2, 4 }));
+  EXPECT_EQ(ms.find_all(target, 2), (std::vector<size_t>{ 0, 2, 4 }));
+  EXPECT_EQ(ms.find_all(target, 3), (std::vector<size_t>{ 0, 2 }));
+  EXPECT_EQ(ms.find_all(target + 1, 2), (std::vector<size_t>{ 1, 3 }));
+
+  target[0] = 0x03;
+  EXPECT_EQ(ms.find_all(target, 1), std::vector<size_t>{});
+  EXPECT_EQ(ms.find_all(target, 1, 1), (std::vector<size_t>{ 0, 1, 2, 3, 4, 5 }));
+
+  EXPECT_EQ(ms.slide(1), 1);
+  target[0] = 0x01;
+  EXPECT_EQ(ms.find_all(target, 3), (std::vector<size_t>{ 1 }));
+  EXPECT_EQ(ms.find_all(target, 10), std::vector<size_t>{});
+}
+
+TEST(MemoryStream, FindParallel)
+{
+  nly::memory_stream ms([](const nly::memory_stream::memory_type& chunk)
+                        { delete[] static_cast<const unsigned char*>(chunk.first); });
+
+  std::mt19937 engine(1234);
+  size_t       total = 0;
+  while (total < 4 * 1024 * 1024)
+  {
+    size_t len = engine() % 100000 + 1;
+    auto   buf = new unsigned char[len];
+    for (size_t i = 0; i < len; ++i)
+    {
+      buf[i] = static_cast<unsigned char>(engine() % 4);
+    }
+    ms.add(buf, len);
+    total += len;
+  }
+  ms.slide(7);
+
+  BS::thread_pool pool(4);
+
+  unsigned char target[] = { 0x01, 0x02, 0x03, 0x00, 0x01, 0x02, 0x03, 0x00, 0x01 };
+  for (size_t len : { 1, 5, 9 })
+  {
+    for (size_t error_bit : { 0, 1, 3 })
+    {
+      auto serial = ms.find_all(target, len, error_bit);
+      EXPECT_EQ(ms.find_all_parallel(pool, target, len, error_bit), serial);
+      EXPECT_EQ(ms.find_all_parallel(pool, target, len, error_bit, 13), serial);
+      EXPECT_EQ(ms.find_parallel(pool, target, len, error_bit), ms.find(target, len, error_bit));
+      EXPECT_EQ(
+        ms.find_parallel(pool, target, len, error_bit, 13),
+        ms.find(target, len, error_bit));
+    }
+  }
+
+  unsigned char absent[] = { 0xFF, 0xFF };
+  EXPECT_EQ(ms.find_parallel(pool, absent, 2), -1);
+  EXPECT_TRUE(ms.find_all_parallel(pool, absent, 2).empty());
+  EXPECT_EQ(ms.find_parallel(pool, absent, 0), 0);
+
+  // the whole stream is scanned for an absent target, the costs are recorded as test properties.
+  auto start_time = nly::now();
+  EXPECT_EQ(ms.find(absent, 2, 1), -1);
+  RecordProperty("find_us", static_cast<int>(nly::time_diff_us(start_time)));
+
+  start_time = nly::now();
+  EXPECT_EQ(ms.find_parallel(pool, absent, 2, 1), -1);
+  RecordProperty("find_parallel_us", static_cast<int>(nly::time_diff_us(start_time)));
+}
+
+TEST(MemoryStream, Coalesce)
+{
+  size_t             release_count = 0;
+  nly::memory_stream ms(
+    [&release_count](const nly::memory_stream::memory_type& chunk)
+    {
+      ++release_count;
+      delete[] static_cast<const unsigned char*>(chunk.first);
+    });
+
+  EXPECT_TRUE(ms.set_coalesce(4, 8));
+
+  // copied and released immediately.
+  ms.add(new unsigned char[3]{ 0x01, 0x02, 0x03 }, 3);
+  ms.add(new unsigned char[3]{ 0x04, 0x05, 0x06 }, 3);
+  ms.add(new unsigned char[3]{ 0x07, 0x08, 0x09 }, 3);
+  EXPECT_EQ(release_count, 3);
+  EXPECT_EQ(ms.copied_byte(), 9);
+  EXPECT_EQ(ms.referenced_byte(), 0);
+  EXPECT_EQ(ms.available_byte(), 9);
+
+  // referenced without copying.
+  ms.add(new unsigned char[4]{ 0x0A, 0x0B, 0x0C, 0x0D }, 4);
+  EXPECT_EQ(release_count, 3);
+  EXPECT_EQ(ms.copied_byte(), 9);
+  EXPECT_EQ(ms.referenced_byte(), 4);
+  EXPECT_EQ(ms.available_byte(), 13);
+
+  ms.add(new unsigned char[1]{ 0x0E }, 1);
+  EXPECT_EQ(release_count, 4);
+  EXPECT_EQ(ms.available_byte(), 14);
+
+  // blocks of a different size are still in use.
+  EXPECT_FALSE(ms.set_coalesce(4, 16));
+  EXPECT_TRUE(ms.set_coalesce(2, 8));
+
+  unsigned char output[14] = {};
+  EXPECT_EQ(ms.peek(output, 14), 14);
+  for (int i = 0; i < 14; ++i)
+  {
+    EXPECT_EQ(output[i], i + 1);
+  }
+
+  unsigned char target[] = { 0x08, 0x09, 0x0A };
+  EXPECT_EQ(ms.find(target, 3), 7);
+
+  EXPECT_EQ(ms.slide(10), 10);
+  EXPECT_EQ(release_count, 4);
+  EXPECT_EQ(ms.peek(output, 14), 4);
+  EXPECT_EQ(output[0], 0x0B);
+  EXPECT_EQ(output[3], 0x0E);
+
+  EXPECT_EQ(ms.slide(4), 4);
+  EXPECT_EQ(release_count, 5);
+  EXPECT_TRUE(ms.set_coalesce(4, 16));
+
+  EXPECT_TRUE(ms.set_coalesce(0));
+  ms.add(new unsigned char[1]{ 0x0F }, 1);
+  EXPECT_EQ(release_count, 5);
+  EXPECT_EQ(ms.referenced_byte(), 5);
+}
+
+TEST(MemoryStream, MarkRewind)
+{
+  size_t             release_count = 0;
+  nly::memory_stream ms(
+    [&release_count](const nly::memory_stream::memory_type& chunk)
+    {
+      ++release_count;
+      delete[] static_cast<const unsigned char*>(chunk.first);
+    });
+
+  unsigned char output[10] = {};
+
+  ms.add(new unsigned char[3]{ 0x01, 0x02, 0x03 }, 3);
+  ms.add(new unsigned char[2]{ 0x04, 0x05 }, 2);
+  EXPECT_FALSE(ms.is_marked());
+  EXPECT_FALSE(ms.rewind());
+
+  EXPECT_EQ(ms.slide(1), 1);
+  ms.mark();
+  EXPECT_TRUE(ms.is_marked());
+
+  // the first chunk is retained instead of released.
+  EXPECT_EQ(ms.slide(3), 3);
+  EXPECT_EQ(release_count, 0);
+  EXPECT_EQ(ms.already_slide_byte(), 4);
+  EXPECT_EQ(ms.available_byte(), 1);
+
+  EXPECT_TRUE(ms.rewind());
+  EXPECT_TRUE(ms.is_marked());
+  EXPECT_EQ(ms.already_slide_byte(), 1);
+  EXPECT_EQ(ms.available_byte(), 4);
+  EXPECT_EQ(ms.peek(output, 10), 4);
+  EXPECT_EQ(output[0], 0x02);
+  EXPECT_EQ(output[3], 0x05);
+
+  // slide everything and add new data behind the mark.
+  EXPECT_EQ(ms.slide(10), 4);
+  EXPECT_EQ(release_count, 0);
+  ms.add(new unsigned char[1]{ 0x06 }, 1);
+  EXPECT_EQ(ms.slide(1), 1);
+
+  EXPECT_TRUE(ms.rewind());
+  EXPECT_EQ(ms.available_byte(), 5);
+  EXPECT_EQ(ms.peek(output, 10), 5);
+  EXPECT_EQ(output[0], 0x02);
+  EXPECT_EQ(output[4], 0x06);
+  unsigned char target[] = { 0x05, 0x06 };
+  EXPECT_EQ(ms.find(target, 2), 3);
+
+  EXPECT_EQ(ms.slide(4), 4);
+  ms.commit();
+  EXPECT_FALSE(ms.is_marked());
+  EXPECT_EQ(release_count, 2);
+  EXPECT_EQ(ms.already_slide_byte(), 5);
+  EXPECT_EQ(ms.available_byte(), 1);
+
+  // a new mark commits the previous one.
+  ms.mark();
+  EXPECT_EQ(ms.slide(1), 1);
+  EXPECT_EQ(release_count, 2);
+  ms.mark();
+  EXPECT_EQ(release_count, 3);
+  EXPECT_TRUE(ms.rewind());
+  EXPECT_EQ(ms.available_byte(), 0);
+}
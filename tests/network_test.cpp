@@ -1,8 +1,55 @@
 #include "gtest/gtest.h"
 #include "nly/network.hpp"
 #include "nly/string.hpp"
+#include "nly/memory_resource.hpp"
 #include <thread>
 #include <map>
+#include <fstream>
+#include <filesystem>
+
+namespace
+{
+
+// counts the allocations passed to upstream, see NetWork.AllocationFree.
+class counting_resource : public std::pmr::memory_resource
+{
+public:
+  explicit counting_resource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+    : upstream_(upstream)
+  {
+  }
+
+public:
+  size_t allocation_count = 0;
+  size_t live_byte = 0;
+  size_t peak_byte = 0;
+
+protected:
+  void* do_allocate(size_t bytes, size_t alignment) override
+  {
+    auto p = upstream_->allocate(bytes, alignment);
+    ++allocation_count;
+    live_byte += bytes;
+    peak_byte = (std::max)(peak_byte, live_byte);
+    return p;
+  }
+
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override
+  {
+    live_byte -= bytes;
+    upstream_->deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+  {
+    return this == &other;
+  }
+
+private:
+  std::pmr::memory_resource* upstream_;
+};
+
+} // namespace
 
 TEST(NetWork, MakeTcpEndPoint)
 {
@@ -38,6 +85,29 @@ TEST(NetWork, MakeResponseMsg)
   EXPECT_EQ(res.version(), 11);
 }
 
+TEST(NetWork, PmrFields)
+{
+  std::pmr::monotonic_buffer_resource resource;
+
+  // copying a polymorphic allocator falls back to the default resource, so build the message with
+  // the allocator instead of copying prepared fields.
+  nly::beast_http::request<nly::beast_http::string_body, nly::pmr_fields> req(
+    nly::beast_http::verb::get,
+    "/hello",
+    11,
+    "bad world",
+    std::pmr::polymorphic_allocator<char>(&resource));
+  req.insert(nly::beast_http::field::host, "www.szn.com");
+  req.prepare_payload();
+
+  EXPECT_EQ(req.at(nly::beast_http::field::host), "www.szn.com");
+  EXPECT_EQ(req.at(nly::beast_http::field::content_length), "9");
+  EXPECT_EQ(req.get_allocator().resource(), &resource);
+
+  nly::http_client client(&resource);
+  EXPECT_FALSE(client.is_connected());
+}
+
 TEST(NetWork, MsgToString)
 {
   nly::beast_http::fields header;
@@ -148,3 +218,558 @@ TEST(NetWork, Http)
 
   thd.join();
 }
+
+TEST(NetWork, WaitLatency)
+{
+  boost::asio::io_context        cxt;
+  boost::asio::ip::tcp::acceptor server(cxt, *nly::make_tcp_endpoint("127.0.0.1", 0));
+  const int                      count = 200;
+
+  std::thread thd(
+    [&server]()
+    {
+      auto                       client = server.accept();
+      std::vector<unsigned char> recv_buffer;
+      for (int i = 0; i < count; ++i)
+      {
+        nly::beast_http::request<nly::beast_http::string_body> req;
+        nly::beast_http::read(client, boost::asio::dynamic_buffer(recv_buffer), req);
+        nly::beast_http::write(client, nly::make_response_msg(req.body()));
+      }
+    });
+
+  nly::http_client client;
+  EXPECT_TRUE(client.set_host(server.local_endpoint()));
+  EXPECT_TRUE(client.connect());
+
+  // every wait used to sleep 1 ms whenever nothing was ready.
+  auto req = nly::make_request_msg(nly::beast_http::verb::post, "/echo", "hello");
+  auto start_time = nly::now();
+  for (int i = 0; i < count; ++i)
+  {
+    auto res = client.deal_command(req);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->body(), "hello");
+  }
+  EXPECT_LT(nly::time_diff_ms(start_time), count);
+
+  thd.join();
+}
+
+TEST(NetWork, Cancel)
+{
+  boost::asio::io_context        cxt;
+  boost::asio::ip::tcp::acceptor server(cxt, *nly::make_tcp_endpoint("127.0.0.1", 0));
+
+  // the server reads requests until the client closes, it never responds.
+  std::thread thd(
+    [&server]()
+    {
+      auto                       client = server.accept();
+      std::vector<unsigned char> recv_buffer;
+      boost::system::error_code  ec;
+      while (!ec)
+      {
+        nly::beast_http::request<nly::beast_http::string_body> req;
+        nly::beast_http::read(client, boost::asio::dynamic_buffer(recv_buffer), req, ec);
+      }
+    });
+
+  nly::http_client client;
+  EXPECT_TRUE(client.set_host(server.local_endpoint()));
+  EXPECT_TRUE(client.connect());
+
+  auto req = nly::make_request_msg(nly::beast_http::verb::get, "/never");
+
+  std::thread canceller(
+    [&client]()
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      client.cancel();
+    });
+  auto start_time = nly::now();
+  EXPECT_FALSE(client.deal_command(req, std::chrono::milliseconds(5000)));
+  EXPECT_LT(nly::time_diff_ms(start_time), 1000);
+  EXPECT_FALSE(client.is_connected());
+  canceller.join();
+
+  // early_terminate is still honoured.
+  EXPECT_TRUE(client.connect());
+  std::atomic<bool> stop{ false };
+  canceller = std::thread(
+    [&stop]()
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      stop = true;
+    });
+  start_time = nly::now();
+  EXPECT_FALSE(
+    client.deal_command(req, std::chrono::milliseconds(5000), [&stop]() { return stop.load(); }));
+  EXPECT_LT(nly::time_diff_ms(start_time), 1000);
+  canceller.join();
+
+  // so is max_wait_time.
+  EXPECT_TRUE(client.connect());
+  start_time = nly::now();
+  EXPECT_FALSE(client.deal_command(req, std::chrono::milliseconds(50)));
+  EXPECT_GE(nly::time_diff_ms(start_time), 50);
+  EXPECT_LT(nly::time_diff_ms(start_time), 1000);
+
+  client.close();
+  server.close();
+  thd.join();
+}
+
+TEST(NetWork, Pipeline)
+{
+  boost::asio::io_context        cxt;
+  boost::asio::ip::tcp::acceptor server(cxt, *nly::make_tcp_endpoint("127.0.0.1", 0));
+  std::atomic<bool>              pipelined{ false };
+
+  // the first connection is closed after 3 responses, the others are kept alive.
+  std::thread thd(
+    [&server, &pipelined]()
+    {
+      for (int i = 0; i < 2; ++i)
+      {
+        auto                       client = server.accept();
+        std::vector<unsigned char> recv_buffer;
+        boost::system::error_code  ec;
+        for (int j = 0; !ec && (i || j < 3); ++j)
+        {
+          nly::beast_http::request<nly::beast_http::string_body> req;
+          nly::beast_http::read(client, boost::asio::dynamic_buffer(recv_buffer), req, ec);
+          if (!ec)
+          {
+            // the next requests arrived with this one.
+            pipelined = pipelined || !recv_buffer.empty();
+            nly::beast_http::write(client, nly::make_response_msg(req.body()), ec);
+          }
+        }
+      }
+    });
+
+  nly::http_client client;
+  EXPECT_TRUE(client.set_host(server.local_endpoint()));
+  EXPECT_TRUE(client.connect());
+  EXPECT_TRUE(client.is_pipelining());
+
+  std::vector<nly::beast_http::request<nly::beast_http::string_body>> reqs;
+  for (int i = 0; i < 10; ++i)
+  {
+    reqs.emplace_back(
+      nly::make_request_msg(nly::beast_http::verb::post, "/echo", std::to_string(i)));
+  }
+
+  auto res = client.deal_commands(reqs);
+  ASSERT_EQ(res.size(), reqs.size());
+  for (int i = 0; i < 10; ++i)
+  {
+    ASSERT_TRUE(res[i]);
+    EXPECT_EQ(res[i]->body(), std::to_string(i));
+  }
+  EXPECT_TRUE(pipelined);
+
+  // the server closed the connection in the middle of the batch.
+  EXPECT_FALSE(client.is_pipelining());
+  EXPECT_TRUE(client.is_connected());
+
+  client.close();
+  EXPECT_TRUE(client.deal_commands(reqs)[0] == std::nullopt);
+  thd.join();
+}
+
+TEST(NetWork, ConnectRacing)
+{
+  boost::asio::io_context        cxt;
+  boost::asio::ip::tcp::acceptor server(cxt, *nly::make_tcp_endpoint("127.0.0.1", 0));
+
+  // a listener never accepting, once its backlog is full it drops the connection attempts.
+  boost::asio::ip::tcp::acceptor hole(cxt);
+  hole.open(boost::asio::ip::tcp::v4());
+  hole.bind(*nly::make_tcp_endpoint("127.0.0.1", 0));
+  hole.listen(0);
+
+  std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> backlog;
+  while (backlog.size() < 16)
+  {
+    bool finish = false;
+    backlog.emplace_back(std::make_unique<boost::asio::ip::tcp::socket>(cxt));
+    backlog.back()->async_connect(
+      hole.local_endpoint(),
+      [&finish](boost::system::error_code) { finish = true; });
+    cxt.run_for(std::chrono::milliseconds(100));
+    if (!finish)
+    {
+      break;
+    }
+  }
+
+  nly::http_client client;
+  EXPECT_TRUE(client.set_host({ hole.local_endpoint(), server.local_endpoint() }));
+
+  auto start_time = nly::now();
+  EXPECT_TRUE(client.connect_racing(std::chrono::milliseconds(50)));
+  EXPECT_LT(nly::time_diff_ms(start_time), 1000);
+  EXPECT_TRUE(client.is_connected());
+  EXPECT_EQ(client.get_socket().remote_endpoint(), server.local_endpoint());
+
+  // a failed attempt starts the next one at once.
+  EXPECT_TRUE(client.set_host(
+    { *nly::make_tcp_endpoint("127.0.0.1", 1), server.local_endpoint() }));
+  start_time = nly::now();
+  EXPECT_TRUE(client.connect_racing(std::chrono::milliseconds(5000)));
+  EXPECT_LT(nly::time_diff_ms(start_time), 1000);
+
+  // max_wait_time bounds the whole race.
+  EXPECT_TRUE(client.set_host(hole.local_endpoint()));
+  start_time = nly::now();
+  EXPECT_FALSE(
+    client.connect_racing(std::chrono::milliseconds(50), std::chrono::milliseconds(200)));
+  EXPECT_GE(nly::time_diff_ms(start_time), 200);
+  EXPECT_LT(nly::time_diff_ms(start_time), 1000);
+  EXPECT_FALSE(client.is_connected());
+
+  // a race ending at its deadline: a connection completing meanwhile is dropped, never returned
+  // closed.
+  EXPECT_TRUE(client.set_host(server.local_endpoint()));
+  for (int i = 0; i < 50; ++i)
+  {
+    if (client.connect_racing(std::chrono::milliseconds(50), std::chrono::milliseconds(0)))
+    {
+      EXPECT_TRUE(client.get_socket().is_open());
+    }
+    client.close();
+  }
+}
+
+TEST(NetWork, Streaming)
+{
+  boost::asio::io_context        cxt;
+  boost::asio::ip::tcp::acceptor server(cxt, *nly::make_tcp_endpoint("127.0.0.1", 0));
+
+  std::string body(300000, 0);
+  for (size_t i = 0; i < body.size(); ++i)
+  {
+    body[i] = static_cast<char>(i % 251);
+  }
+
+  // "/chunked" is answered with a chunked body, anything else with a content-length.
+  std::thread thd(
+    [&server, &body]()
+    {
+      for (int i = 0; i < 2; ++i)
+      {
+        auto                       client = server.accept();
+        std::vector<unsigned char> recv_buffer;
+        boost::system::error_code  ec;
+        while (!ec)
+        {
+          nly::beast_http::request<nly::beast_http::string_body> req;
+          nly::beast_http::read(client, boost::asio::dynamic_buffer(recv_buffer), req, ec);
+          if (!ec)
+          {
+            auto rep = nly::make_response_msg(body);
+            if (req.target() == "/chunked")
+            {
+              rep.chunked(true);
+            }
+            nly::beast_http::write(client, rep, ec);
+          }
+        }
+      }
+    });
+
+  nly::http_client client;
+  EXPECT_TRUE(client.set_host(server.local_endpoint()));
+  EXPECT_TRUE(client.connect());
+
+  std::string received;
+  size_t      max_fragment = 0;
+  auto        head = client.deal_command_streaming(
+    nly::make_request_msg(nly::beast_http::verb::get, "/chunked"),
+    [&received, &max_fragment](const void* data, size_t len)
+    {
+      received.append(static_cast<const char*>(data), len);
+      max_fragment = (std::max)(max_fragment, len);
+      return true;
+    },
+    std::chrono::milliseconds(5000),
+    nullptr,
+    4096);
+  ASSERT_TRUE(head);
+  EXPECT_EQ(head->result(), nly::beast_http::status::ok);
+  EXPECT_EQ((*head)[nly::beast_http::field::transfer_encoding], "chunked");
+  EXPECT_EQ(received, body);
+  EXPECT_LE(max_fragment, 4096);
+
+  // the connection is kept alive.
+  {
+    nly::memory_stream stream(nly::release_body_fragment);
+    EXPECT_TRUE(client.deal_command_streaming(
+      nly::make_request_msg(nly::beast_http::verb::get, "/plain"),
+      nly::make_memory_stream_sink(stream)));
+    ASSERT_EQ(stream.available_byte(), body.size());
+
+    std::string copy(body.size(), 0);
+    stream.peek(copy.data(), copy.size());
+    EXPECT_EQ(copy, body);
+  }
+
+  // a sink returning false stops the read and closes the connection.
+  EXPECT_FALSE(client.deal_command_streaming(
+    nly::make_request_msg(nly::beast_http::verb::get, "/plain"),
+    [](const void*, size_t) { return false; }));
+  EXPECT_FALSE(client.is_connected());
+
+  EXPECT_TRUE(client.connect());
+  auto path = std::filesystem::temp_directory_path() / "nly_network_streaming.bin";
+  EXPECT_TRUE(client.deal_command_streaming(
+    nly::make_request_msg(nly::beast_http::verb::get, "/plain"),
+    nly::make_file_sink(path.string())));
+  {
+    std::ifstream file(path, std::ios::binary);
+    std::string   content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, body);
+  }
+  std::filesystem::remove(path);
+  EXPECT_FALSE(nly::make_file_sink((path / "missing" / "file").string()));
+
+  client.close();
+  server.close();
+  thd.join();
+}
+
+TEST(NetWork, Serialize)
+{
+  nly::beast_http::fields header;
+  header.insert(nly::beast_http::field::host, "www.szn.com");
+
+  auto req = nly::make_request_msg(nly::beast_http::verb::get, "/hello", "bad world", header);
+  std::string target =
+    "GET /hello HTTP/1.1\r\nHost: www.szn.com\r\nContent-Length: 9\r\n\r\nbad world";
+  EXPECT_EQ(nly::serialized_size(req), target.size());
+  EXPECT_EQ(nly::msg_to_string(req), target);
+
+  std::string out(target.size(), 0);
+  EXPECT_EQ(nly::serialize_to(req, out.data(), out.size()), target.size());
+  EXPECT_EQ(out, target);
+  EXPECT_EQ(nly::serialize_to(req, out.data(), out.size() - 1), 0);
+
+  std::pmr::monotonic_buffer_resource resource;
+  auto                                pmr_string = nly::msg_to_pmr_string(req, &resource);
+  EXPECT_EQ(std::string_view(pmr_string), target);
+  EXPECT_EQ(pmr_string.get_allocator().resource(), &resource);
+
+  auto res = nly::make_response_msg("bad world", nly::beast_http::status::not_found, header);
+  res.chunked(true);
+  target = "HTTP/1.1 404 Not Found\r\nHost: www.szn.com\r\nTransfer-Encoding: chunked\r\n\r\n"
+           "9\r\nbad world\r\n0\r\n\r\n";
+  EXPECT_EQ(nly::serialized_size(res), target.size());
+  EXPECT_EQ(nly::msg_to_string(res), target);
+}
+
+TEST(NetWork, PrebakedRequest)
+{
+  nly::beast_http::fields header;
+  header.insert(nly::beast_http::field::host, "www.szn.com");
+  header.insert(nly::beast_http::field::user_agent, "nly");
+
+  nly::prebaked_request get(nly::beast_http::verb::get, header);
+  auto                  expected =
+    nly::msg_to_string(nly::make_request_msg(nly::beast_http::verb::get, "/a", "", header));
+  EXPECT_EQ(get.size("/a"), expected.size());
+  auto buffer = get.build("/a");
+  EXPECT_EQ(std::string(static_cast<const char*>(buffer.data()), buffer.size()), expected);
+
+  expected = nly::msg_to_string(
+    nly::make_request_msg(nly::beast_http::verb::get, "/b?q=1", "body", header));
+  buffer = get.build("/b?q=1", "body");
+  EXPECT_EQ(std::string(static_cast<const char*>(buffer.data()), buffer.size()), expected);
+
+  std::string out(expected.size(), 0);
+  EXPECT_EQ(get.write_to("/b?q=1", "body", out.data(), out.size()), expected.size());
+  EXPECT_EQ(out, expected);
+  EXPECT_EQ(get.write_to("/b?q=1", "body", out.data(), out.size() - 1), 0);
+
+  // POST always has a Content-Length.
+  nly::prebaked_request post(nly::beast_http::verb::post, header);
+  expected =
+    nly::msg_to_string(nly::make_request_msg(nly::beast_http::verb::post, "/c", "", header));
+  buffer = post.build("/c");
+  EXPECT_EQ(std::string(static_cast<const char*>(buffer.data()), buffer.size()), expected);
+
+  // a prebaked request is sent by deal_command.
+  boost::asio::io_context        cxt;
+  boost::asio::ip::tcp::acceptor server(cxt, *nly::make_tcp_endpoint("127.0.0.1", 0));
+  std::thread                    thd(
+    [&server]()
+    {
+      auto                       client = server.accept();
+      std::vector<unsigned char> recv_buffer;
+      boost::system::error_code  ec;
+      while (!ec)
+      {
+        nly::beast_http::request<nly::beast_http::string_body> req;
+        nly::beast_http::read(client, boost::asio::dynamic_buffer(recv_buffer), req, ec);
+        if (!ec)
+        {
+          auto body = std::string(req.target()) + " " + req.body();
+          nly::beast_http::write(client, nly::make_response_msg(body), ec);
+        }
+      }
+    });
+
+  nly::http_client client;
+  EXPECT_TRUE(client.set_host(server.local_endpoint()));
+  EXPECT_TRUE(client.connect());
+  for (int i = 0; i < 3; ++i)
+  {
+    auto target = "/" + std::to_string(i);
+    auto rep = client.deal_command(post.build(target, "hello"));
+    ASSERT_TRUE(rep);
+    EXPECT_EQ(rep->body(), target + " hello");
+  }
+
+  client.close();
+  server.close();
+  thd.join();
+}
+
+TEST(NetWork, AllocationFree)
+{
+  boost::asio::io_context        cxt;
+  boost::asio::ip::tcp::acceptor server(cxt, *nly::make_tcp_endpoint("127.0.0.1", 0));
+  std::thread                    thd(
+    [&server]()
+    {
+      auto                       client = server.accept();
+      std::vector<unsigned char> recv_buffer;
+      boost::system::error_code  ec;
+      while (!ec)
+      {
+        nly::beast_http::request<nly::beast_http::string_body> req;
+        nly::beast_http::read(client, boost::asio::dynamic_buffer(recv_buffer), req, ec);
+        if (!ec)
+        {
+          auto rep = nly::make_response_msg(req.body());
+          rep.set(nly::beast_http::field::server, "nly");
+          nly::beast_http::write(client, rep, ec);
+        }
+      }
+    });
+
+  nly::size_class_pool<>     pool;
+  nly::size_class_resource<> pool_resource(pool);
+  counting_resource          resource(&pool_resource);
+  nly::http_client           client(&resource);
+  EXPECT_TRUE(client.set_host(server.local_endpoint()));
+  EXPECT_TRUE(client.connect());
+
+  auto req = nly::make_request_msg(nly::beast_http::verb::post, "/echo", std::string(1000, 'x'));
+  nly::beast_http::response<nly::beast_http::string_body, nly::pmr_fields> rep(
+    nly::beast_http::status::ok,
+    11,
+    "",
+    std::pmr::polymorphic_allocator<char>(&resource));
+
+  // the buffers grow on the first cycles.
+  for (int i = 0; i < 3; ++i)
+  {
+    ASSERT_TRUE(client.deal_command(req, rep));
+  }
+
+  // The client takes its memory from the pool, which holds what the first cycles needed at most,
+  // and nothing falls back to the default resource.
+  counting_resource fallback;
+  auto              previous = std::pmr::set_default_resource(&fallback);
+  auto              peak_byte = resource.peak_byte;
+  auto              allocation_count = resource.allocation_count;
+  for (int i = 0; i < 100; ++i)
+  {
+    EXPECT_TRUE(client.deal_command(req, rep));
+  }
+  std::pmr::set_default_resource(previous);
+
+  EXPECT_EQ(fallback.allocation_count, 0);
+  EXPECT_EQ(resource.peak_byte, peak_byte);
+  EXPECT_GT(resource.allocation_count, allocation_count);
+  EXPECT_EQ(rep.body(), req.body());
+  EXPECT_EQ(rep[nly::beast_http::field::server], "nly");
+  EXPECT_EQ(rep.get_allocator().resource(), &resource);
+
+  client.close();
+  server.close();
+  thd.join();
+}
+
+TEST(NetWork, Timing)
+{
+  boost::asio::io_context        cxt;
+  boost::asio::ip::tcp::acceptor server(cxt, *nly::make_tcp_endpoint("127.0.0.1", 0));
+
+  // "/slow" is answered after 30 ms.
+  std::thread thd(
+    [&server]()
+    {
+      auto                       client = server.accept();
+      std::vector<unsigned char> recv_buffer;
+      boost::system::error_code  ec;
+      while (!ec)
+      {
+        nly::beast_http::request<nly::beast_http::string_body> req;
+        nly::beast_http::read(client, boost::asio::dynamic_buffer(recv_buffer), req, ec);
+        if (!ec)
+        {
+          if (req.target() == "/slow")
+          {
+            std::this_thread::sleep_for(std::chrono::milliseconds(30));
+          }
+          nly::beast_http::write(client, nly::make_response_msg("hello"), ec);
+        }
+      }
+    });
+
+  auto stats = std::make_shared<nly::http_timing_stats>();
+  auto port = std::to_string(server.local_endpoint().port());
+
+  nly::http_client client;
+  client.set_timing_stats(stats);
+  EXPECT_TRUE(client.set_host("127.0.0.1", port));
+  EXPECT_GE(client.get_timing().resolve_us(), 0);
+  EXPECT_TRUE(client.connect());
+
+  auto req = nly::make_request_msg(nly::beast_http::verb::get, "/slow");
+  EXPECT_TRUE(client.deal_command(req));
+  auto timing = client.get_timing();
+  EXPECT_GE(timing.resolve_us(), 0);
+  EXPECT_GE(timing.connect_us(), 0);
+  EXPECT_GE(timing.write_us(), 0);
+  EXPECT_GE(timing.ttfb_us(), 30000);
+  EXPECT_GE(timing.body_us(), 0);
+  EXPECT_GE(timing.total_us(), timing.ttfb_us());
+
+  // the next request only has its own phases.
+  req.target("/fast");
+  EXPECT_TRUE(client.deal_command(req));
+  timing = client.get_timing();
+  EXPECT_EQ(timing.resolve_us(), -1);
+  EXPECT_EQ(timing.connect_us(), -1);
+  EXPECT_LT(timing.ttfb_us(), 30000);
+  EXPECT_EQ(timing.total_us(), nly::time_diff_us(timing.write_start, timing.body_end));
+
+  EXPECT_TRUE(client.deal_command_streaming(req, [](const void*, size_t) { return true; }));
+  EXPECT_GE(client.get_timing().body_us(), 0);
+
+  auto host = stats->get("127.0.0.1:" + port);
+  ASSERT_TRUE(host);
+  EXPECT_EQ(host->total.count(), 3);
+  EXPECT_EQ(host->resolve.count(), 1);
+  EXPECT_GE(host->ttfb.max(), 30000);
+
+  EXPECT_EQ(stats->hosts(), std::vector<std::string>{ "127.0.0.1:" + port });
+
+  client.close();
+  server.close();
+  thd.join();
+}
@@ -0,0 +1,141 @@
+#include "gtest/gtest.h"
+#include "nly/object_pool.hpp"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct message
+{
+  message(int id, std::string body)
+    : id(id)
+    , body(std::move(body))
+  {
+    ++alive;
+  }
+
+  ~message()
+  {
+    --alive;
+  }
+
+  int         id;
+  std::string body;
+
+  static std::atomic<int> alive;
+};
+
+std::atomic<int> message::alive{ 0 };
+
+struct throwing
+{
+  throwing()
+  {
+    throw std::runtime_error("throwing");
+  }
+};
+} // namespace
+
+TEST(ObjectPool, Construct)
+{
+  nly::object_pool<message> pool;
+
+  auto p = pool.construct(1, "hello");
+  EXPECT_EQ(p->id, 1);
+  EXPECT_EQ(p->body, "hello");
+  EXPECT_EQ(message::alive, 1);
+
+  pool.destroy(p);
+  EXPECT_EQ(message::alive, 0);
+  pool.destroy(nullptr);
+
+  // the node is reused.
+  auto q = pool.construct(2, "world");
+  EXPECT_EQ(q, p);
+  pool.destroy(q);
+
+  nly::object_pool<throwing> throwing_pool(4);
+  EXPECT_THROW(throwing_pool.construct(), std::runtime_error);
+}
+
+TEST(ObjectPool, Handle)
+{
+  nly::object_pool<message> pool;
+  {
+    auto handle = pool.make_unique(1, "hello");
+    EXPECT_EQ(handle->body, "hello");
+    EXPECT_EQ(message::alive, 1);
+
+    std::vector<nly::object_pool<message>::handle> handles;
+    for (int i = 0; i < 100; ++i)
+    {
+      handles.emplace_back(pool.make_unique(i, std::to_string(i)));
+    }
+    EXPECT_EQ(message::alive, 101);
+    EXPECT_EQ(handles[99]->body, "99");
+  }
+  EXPECT_EQ(message::alive, 0);
+}
+
+TEST(ObjectPool, Shared)
+{
+  nly::object_pool<message, nly::memory_pool<boost::signals2::dummy_mutex, true>> pool;
+  EXPECT_EQ(pool.shared_pool(), nullptr);
+  {
+    auto shared = pool.make_shared(1, "hello");
+    ASSERT_NE(pool.shared_pool(), nullptr);
+    auto copy = shared;
+    EXPECT_EQ(copy->body, "hello");
+    EXPECT_EQ(shared.use_count(), 2);
+    EXPECT_EQ(message::alive, 1);
+
+    std::weak_ptr<message> weak = shared;
+    shared.reset();
+    copy.reset();
+    EXPECT_EQ(message::alive, 0);
+    EXPECT_TRUE(weak.expired());
+
+    // the control block, and so the node, stays until the weak_ptr is gone.
+    EXPECT_EQ(pool.shared_pool()->snapshot().live_node, 1);
+    weak.reset();
+    EXPECT_EQ(pool.shared_pool()->snapshot().live_node, 0);
+
+    // the object and its control block share a node of the shared pool.
+    auto p0 = pool.make_shared(2, "a");
+    auto p1 = pool.make_shared(3, "b");
+    EXPECT_EQ(pool.shared_pool()->snapshot().live_node, 2);
+    EXPECT_GT(pool.shared_pool()->node_size(), sizeof(message));
+    EXPECT_EQ(pool.pool().snapshot().live_node, 0);
+    EXPECT_EQ(pool.pool().node_size(), sizeof(message));
+  }
+  EXPECT_EQ(message::alive, 0);
+  EXPECT_EQ(pool.shared_pool()->snapshot().live_node, 0);
+}
+
+TEST(ObjectPool, ThreadCached)
+{
+  nly::object_pool<message, nly::thread_cached_memory_pool> pool(16);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i)
+  {
+    threads.emplace_back(
+      [&pool, i]()
+      {
+        for (int j = 0; j < 10000; ++j)
+        {
+          auto handle = pool.make_unique(i, "a body longer than the small string buffer");
+          auto shared = pool.make_shared(j, "short");
+          EXPECT_EQ(handle->id, i);
+          EXPECT_EQ(shared->id, j);
+        }
+      });
+  }
+
+  for (auto& item : threads)
+  {
+    item.join();
+  }
+}
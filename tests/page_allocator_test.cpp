@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+#include "nly/page_allocator.hpp"
+#include "nly/memory_pool.hpp"
+#include "nly/time/time_count.hpp"
+#include <cstring>
+
+namespace
+{
+// Unpack 12-bit samples at random positions of buff, so nearly every read lands on another page.
+template<typename t_pool>
+unsigned long long unpack_random(t_pool& pool, const size_t size, double& cost_time)
+{
+  auto buff = static_cast<unsigned char*>(pool.malloc());
+  EXPECT_TRUE(buff);
+  for (size_t i = 0; i < size; ++i)
+  {
+    buff[i] = static_cast<unsigned char>(i * 31);
+  }
+
+  auto               start_time = nly::now();
+  unsigned long long sum = 0;
+  unsigned long long seed = 88172645463325252ULL;
+  for (int i = 0; i < 1000000; ++i)
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+
+    auto p = buff + seed % (size - 2);
+    sum += (p[0] << 4 | p[1] >> 4) + ((p[1] & 0x0F) << 8 | p[2]);
+  }
+  cost_time = nly::time_diff(start_time);
+
+  pool.free(buff);
+  return sum;
+}
+} // namespace
+
+TEST(PageAllocator, Allocate)
+{
+  nly::memory_pool<boost::signals2::dummy_mutex, false, nly::huge_page_user_allocator> pool(100);
+
+  auto before = nly::huge_page_user_allocator::stats();
+  auto p = static_cast<char*>(pool.malloc());
+  EXPECT_TRUE(p);
+  memset(p, 1, 100);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t), 0);
+
+  auto after = nly::huge_page_user_allocator::stats();
+  EXPECT_EQ(
+    after.huge_tlb_count + after.transparent_count + after.fallback_count,
+    before.huge_tlb_count + before.transparent_count + before.fallback_count + 1);
+  EXPECT_EQ(after.numa_bind_count, 0);
+
+  // a small block isn't rounded up to a huge page.
+  EXPECT_EQ(after.huge_tlb_count, before.huge_tlb_count);
+
+  pool.free(p);
+  EXPECT_TRUE(pool.release_unused());
+
+  nly::memory_pool<std::mutex, false, nly::numa_local_user_allocator> numa_pool(4096, 2);
+  p = static_cast<char*>(numa_pool.malloc());
+  EXPECT_TRUE(p);
+  memset(p, 1, 4096);
+  numa_pool.free(p);
+}
+
+TEST(PageAllocator, RetryHugeTlb)
+{
+  typedef nly::huge_page_user_allocator allocator;
+
+  allocator::retry_huge_tlb();
+  auto before = allocator::stats();
+  auto p = allocator::malloc(allocator::huge_page_size);
+  EXPECT_TRUE(p);
+  allocator::free(p);
+
+  auto after = allocator::stats();
+  if (after.huge_tlb_count != before.huge_tlb_count)
+  {
+    // huge pages are reserved, nothing to retry.
+    EXPECT_EQ(after.huge_tlb_failure_count, before.huge_tlb_failure_count);
+    return;
+  }
+  EXPECT_EQ(after.huge_tlb_failure_count, before.huge_tlb_failure_count + 1);
+
+  // the next blocks skip MAP_HUGETLB.
+  p = allocator::malloc(allocator::huge_page_size);
+  EXPECT_TRUE(p);
+  allocator::free(p);
+  EXPECT_EQ(allocator::stats().huge_tlb_failure_count, after.huge_tlb_failure_count);
+
+  for (size_t i = 1; i < allocator::huge_tlb_retry_interval; ++i)
+  {
+    p = allocator::malloc(allocator::huge_page_size);
+    allocator::free(p);
+  }
+  EXPECT_EQ(allocator::stats().huge_tlb_failure_count, after.huge_tlb_failure_count);
+
+  // tried again once the interval passed.
+  p = allocator::malloc(allocator::huge_page_size);
+  allocator::free(p);
+  EXPECT_EQ(allocator::stats().huge_tlb_failure_count, after.huge_tlb_failure_count + 1);
+
+  // and at once after retry_huge_tlb.
+  allocator::retry_huge_tlb();
+  p = allocator::malloc(allocator::huge_page_size);
+  allocator::free(p);
+  EXPECT_EQ(allocator::stats().huge_tlb_failure_count, after.huge_tlb_failure_count + 2);
+}
+
+// A benchmark of the unpack path, the wall times are recorded as test properties and not compared,
+// they depend on the machine and don't count the TLB misses.
+TEST(PageAllocator, UnpackBenchmark)
+{
+  const size_t size = 32 * 1024 * 1024;
+
+  double normal_cost_time = 0;
+  double huge_cost_time = 0;
+
+  nly::memory_pool<> normal_pool(size, 1);
+  nly::memory_pool<boost::signals2::dummy_mutex, false, nly::huge_page_user_allocator> huge_pool(
+    size,
+    1);
+
+  auto normal_sum = unpack_random(normal_pool, size, normal_cost_time);
+  auto huge_sum = unpack_random(huge_pool, size, huge_cost_time);
+  EXPECT_EQ(normal_sum, huge_sum);
+
+  RecordProperty("normal_cost_ms", static_cast<int>(normal_cost_time * 1000));
+  RecordProperty("huge_page_cost_ms", static_cast<int>(huge_cost_time * 1000));
+}
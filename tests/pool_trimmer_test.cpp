@@ -0,0 +1,75 @@
+#include "gtest/gtest.h"
+#include "nly/pool_trimmer.hpp"
+#include "nly/memory_pool.hpp"
+#include "nly/size_class_pool.hpp"
+#include <thread>
+#include <vector>
+
+TEST(PoolTrimmer, All)
+{
+  nly::memory_pool_s        pool(64, 4, 4);
+  nly::size_class_pool_s    classes(64, 1024, 4);
+  nly::trim_policy          policy;
+  policy.decay_time = std::chrono::milliseconds(0);
+  pool.set_trim_policy(policy);
+  classes.set_trim_policy(policy);
+
+  std::vector<void*> nodes(256);
+  EXPECT_EQ(pool.malloc_n(nodes.size(), nodes.data()), nodes.size());
+  pool.free_n(nodes.data(), nodes.size());
+  EXPECT_EQ(pool.free_node(), 256);
+
+  for (auto& item : nodes)
+  {
+    item = classes.malloc(100);
+  }
+  for (auto item : nodes)
+  {
+    classes.free(item);
+  }
+
+  nly::pool_trimmer trimmer(std::chrono::milliseconds(10));
+  auto              id = trimmer.add(pool);
+  trimmer.add(classes);
+
+  for (int i = 0; i < 500 && pool.free_node(); ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(pool.free_node(), 0);
+  for (int i = 0; i < 500 && trimmer.released_byte() < 2 * 256 * 64; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_TRUE(trimmer.released_byte() >= 2 * 256 * 64);
+
+  // a removed pool is not trimmed.
+  trimmer.remove(id);
+  EXPECT_EQ(pool.malloc_n(nodes.size(), nodes.data()), nodes.size());
+  pool.free_n(nodes.data(), nodes.size());
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(pool.free_node(), 256);
+}
+
+TEST(PoolTrimmer, Wake)
+{
+  nly::pool_trimmer  trimmer(std::chrono::milliseconds(60000));
+  nly::memory_pool_s pool(64, 4, 4);
+  nly::trim_policy   policy;
+  policy.high_watermark = 64 * 64;
+  policy.decay_time = std::chrono::milliseconds(60000);
+  policy.on_high_watermark = [&trimmer]() { trimmer.wake(); };
+  pool.set_trim_policy(policy);
+  auto id = trimmer.add(pool);
+
+  // the pool is trimmed long before the interval.
+  std::vector<void*> nodes(256);
+  EXPECT_EQ(pool.malloc_n(nodes.size(), nodes.data()), nodes.size());
+  pool.free_n(nodes.data(), nodes.size());
+  for (int i = 0; i < 500 && pool.free_node(); ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(pool.free_node(), 0);
+  trimmer.remove(id);
+}
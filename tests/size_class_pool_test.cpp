@@ -0,0 +1,91 @@
+#include "gtest/gtest.h"
+#include "nly/size_class_pool.hpp"
+#include <cstring>
+#include <thread>
+#include <vector>
+
+TEST(SizeClassPool, ClassSize)
+{
+  nly::size_class_pool<> pool(64, 1024);
+  EXPECT_EQ(pool.class_count(), 5);
+  EXPECT_EQ(pool.class_size(0), 64);
+  EXPECT_EQ(pool.class_size(4), 1024);
+
+  for (size_t size : { 0, 1, 63, 64, 65, 128, 129, 1000, 1023, 1024, 1025, 100000 })
+  {
+    auto p = pool.malloc(size);
+    EXPECT_TRUE(p);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t), 0);
+    memset(p, 0xAB, size);
+
+    size_t expect = 64;
+    while (expect < size)
+    {
+      expect *= 2;
+    }
+    EXPECT_EQ(pool.usable_size(p), size > 1024 ? 1025 : expect);
+    pool.free(p);
+  }
+
+  pool.free(nullptr);
+}
+
+TEST(SizeClassPool, Reuse)
+{
+  nly::size_class_pool<> pool;
+
+  auto p0 = pool.malloc(100);
+  auto p1 = pool.malloc(200);
+  EXPECT_NE(p0, p1);
+  pool.free(p0);
+  pool.free(p1);
+
+  // every class keeps its own free list.
+  EXPECT_EQ(pool.malloc(128), p0);
+  EXPECT_EQ(pool.malloc(256), p1);
+  pool.free(p0);
+  pool.free(p1);
+
+  EXPECT_TRUE(pool.release_unused());
+}
+
+TEST(SizeClassPool, MultiThread)
+{
+  nly::size_class_pool_s   pool;
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < 4; ++i)
+  {
+    threads.emplace_back(
+      [&pool, i]()
+      {
+        std::vector<std::pair<unsigned char*, size_t>> blocks;
+        for (size_t j = 0; j < 2000; ++j)
+        {
+          auto size = (j * 7919 + i) % (70 * 1024) + 1;
+          auto p = static_cast<unsigned char*>(pool.malloc(size));
+          ASSERT_TRUE(p);
+          memset(p, i, size);
+          blocks.emplace_back(p, size);
+
+          if (j % 2)
+          {
+            pool.free(blocks.front().first);
+            blocks.erase(blocks.begin());
+          }
+        }
+
+        for (auto& item : blocks)
+        {
+          EXPECT_EQ(item.first[0], i);
+          EXPECT_EQ(item.first[item.second - 1], i);
+          pool.free(item.first);
+        }
+      });
+  }
+
+  for (auto& item : threads)
+  {
+    item.join();
+  }
+}
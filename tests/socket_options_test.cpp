@@ -0,0 +1,140 @@
+#include "gtest/gtest.h"
+#include "nly/socket_options.hpp"
+#include "nly/network.hpp"
+#include "nly/time/time_count.hpp"
+#include <thread>
+#include <iostream>
+#include <algorithm>
+
+namespace
+{
+
+// The median latency of requests written in two small writes, the header and then the body, as a
+// client streaming a request does. With Nagle's algorithm the body waits for the ACK of the header,
+// which the server delays.
+long long small_request_latency_us(const nly::socket_options& options, int count)
+{
+  boost::asio::io_context        cxt;
+  boost::asio::ip::tcp::acceptor server(cxt, *nly::make_tcp_endpoint("127.0.0.1", 0));
+  std::thread                    thd(
+    [&server]()
+    {
+      auto                       client = server.accept();
+      std::vector<unsigned char> recv_buffer;
+      boost::system::error_code  ec;
+      while (!ec)
+      {
+        nly::beast_http::request<nly::beast_http::string_body> req;
+        nly::beast_http::read(client, boost::asio::dynamic_buffer(recv_buffer), req, ec);
+        if (!ec)
+        {
+          nly::beast_http::write(client, nly::make_response_msg(req.body()), ec);
+        }
+      }
+    });
+
+  boost::asio::ip::tcp::socket sock(cxt);
+  sock.open(boost::asio::ip::tcp::v4());
+  options.apply(sock);
+  sock.connect(server.local_endpoint());
+
+  const std::string header = "POST / HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 5\r\n\r\n";
+  const std::string body = "hello";
+
+  std::vector<long long>     latencies;
+  std::vector<unsigned char> recv_buffer;
+  for (int i = 0; i < count; ++i)
+  {
+    auto start = nly::now();
+    boost::asio::write(sock, boost::asio::buffer(header));
+    boost::asio::write(sock, boost::asio::buffer(body));
+
+    nly::beast_http::response<nly::beast_http::string_body> rep;
+    options.rearm_quick_ack(sock);
+    nly::beast_http::read(sock, boost::asio::dynamic_buffer(recv_buffer), rep);
+    latencies.push_back(nly::time_diff_us(start));
+  }
+
+  sock.close();
+  server.close();
+  thd.join();
+
+  std::sort(latencies.begin(), latencies.end());
+  return latencies[latencies.size() / 2];
+}
+
+} // namespace
+
+TEST(SocketOptions, Apply)
+{
+  boost::asio::io_context      cxt;
+  boost::asio::ip::tcp::socket sock(cxt);
+  sock.open(boost::asio::ip::tcp::v4());
+
+  auto options = nly::socket_options::low_latency();
+  options.receive_buffer_byte = 256 * 1024;
+  EXPECT_TRUE(options.apply(sock));
+
+  boost::asio::ip::tcp::no_delay no_delay;
+  sock.get_option(no_delay);
+  EXPECT_TRUE(no_delay.value());
+
+  boost::asio::socket_base::keep_alive keep_alive;
+  sock.get_option(keep_alive);
+  EXPECT_TRUE(keep_alive.value());
+
+  boost::asio::socket_base::receive_buffer_size receive_buffer;
+  sock.get_option(receive_buffer);
+  EXPECT_GE(receive_buffer.value(), 256 * 1024);
+
+#ifdef TCP_KEEPIDLE
+  boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPIDLE> idle;
+  sock.get_option(idle);
+  EXPECT_EQ(idle.value(), 30);
+#endif
+
+  // the options left empty are not touched.
+  nly::socket_options none;
+  EXPECT_FALSE(none.no_delay);
+  EXPECT_TRUE(none.apply(sock));
+  sock.get_option(no_delay);
+  EXPECT_TRUE(no_delay.value());
+
+  // a closed socket.
+  boost::asio::ip::tcp::socket closed(cxt);
+  EXPECT_FALSE(options.apply(closed));
+}
+
+TEST(SocketOptions, Client)
+{
+  boost::asio::io_context        cxt;
+  boost::asio::ip::tcp::acceptor server(cxt, *nly::make_tcp_endpoint("127.0.0.1", 0));
+
+  nly::http_client client;
+  client.set_socket_options(nly::socket_options::pooled());
+  EXPECT_TRUE(client.set_host(server.local_endpoint()));
+  EXPECT_TRUE(client.connect());
+
+  boost::asio::socket_base::keep_alive keep_alive;
+  client.get_socket().get_option(keep_alive);
+  EXPECT_TRUE(keep_alive.value());
+
+  // applied at once to a connected client.
+  auto options = nly::socket_options::pooled();
+  options.keep_alive = false;
+  client.set_socket_options(options);
+  client.get_socket().get_option(keep_alive);
+  EXPECT_FALSE(keep_alive.value());
+}
+
+TEST(SocketOptions, SmallRequestLatency)
+{
+  nly::socket_options nagle;
+  nagle.no_delay = false;
+
+  auto with_nagle = small_request_latency_us(nagle, 20);
+  auto low_latency = small_request_latency_us(nly::socket_options::low_latency(), 20);
+  std::cout << "small request p50: " << with_nagle << " us with Nagle, " << low_latency
+            << " us with low_latency" << std::endl;
+  EXPECT_LT(low_latency, with_nagle);
+}
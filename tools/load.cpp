@@ -0,0 +1,164 @@
+// Load generator for nly::http_client and HTTP servers, see nly/load_generator.hpp.
+//
+// nly_load [options] <url>
+// nly_load [options] --self
+//
+// -c <count>   connections, 1 by default
+// -r <rate>    requests per second over every connection, 0 (closed-loop) by default
+// -d <second>  duration, 10 by default
+// -t <ms>      timeout of a request, 5000 by default
+// -m <method>  GET by default
+// -b <body>    the body of every request
+// -e <us>      closed-loop only, the expected interval correcting coordinated omission, the mean
+//              latency of every connection by default
+// -s <count>   --self only, the threads of the server, 1 by default
+// -p <preset>  socket options: default (the system's), low_latency, bulk, see
+//              nly/socket_options.hpp
+// -o <path>    also writes the JSON result to path
+// --self       runs against an nly::http_server started in the process, answering "/"
+//
+// The result is printed as JSON on stdout.
+
+#include "nly/load_generator.hpp"
+#include "nly/http_server.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+
+int usage()
+{
+  std::cerr << "usage: nly_load [-c connections] [-r rate] [-d seconds] [-t timeout_ms] [-m method]"
+               " [-b body] [-e expected_interval_us] [-s server_threads] [-p socket_preset]"
+               " [-o output.json]"
+               " <url | --self>"
+            << std::endl;
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  nly::load_generator::options opt;
+  std::string                  output;
+  bool                         self = false;
+  size_t                       server_threads = 1;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--self")
+    {
+      self = true;
+      continue;
+    }
+
+    if (arg.size() != 2 || arg[0] != '-')
+    {
+      opt.url = arg;
+      continue;
+    }
+
+    if (i + 1 >= argc)
+    {
+      return usage();
+    }
+
+    std::string value = argv[++i];
+    switch (arg[1])
+    {
+    case 'c':
+      opt.connection_count = std::strtoull(value.c_str(), nullptr, 10);
+      break;
+    case 'r':
+      opt.rate = std::strtod(value.c_str(), nullptr);
+      break;
+    case 'd':
+      opt.duration = std::chrono::milliseconds(
+        static_cast<long long>(std::strtod(value.c_str(), nullptr) * 1000));
+      break;
+    case 't':
+      opt.timeout = std::chrono::milliseconds(std::strtoll(value.c_str(), nullptr, 10));
+      break;
+    case 'm':
+      opt.method = nly::beast_http::string_to_verb(value);
+      if (opt.method == nly::beast_http::verb::unknown)
+      {
+        return usage();
+      }
+      break;
+    case 'b':
+      opt.body = value;
+      break;
+    case 'e':
+      opt.expected_interval = std::chrono::microseconds(std::strtoll(value.c_str(), nullptr, 10));
+      break;
+    case 's':
+      server_threads = std::strtoull(value.c_str(), nullptr, 10);
+      break;
+    case 'p':
+      if (value == "low_latency")
+      {
+        opt.socket = nly::socket_options::low_latency();
+      }
+      else if (value == "bulk")
+      {
+        opt.socket = nly::socket_options::bulk();
+      }
+      else if (value != "default")
+      {
+        return usage();
+      }
+      break;
+    case 'o':
+      output = value;
+      break;
+    default:
+      return usage();
+    }
+  }
+
+  nly::http_server_options server_opt;
+  server_opt.thread_count = server_threads;
+  nly::http_server server(server_opt);
+  if (self)
+  {
+    server.route(
+      nly::beast_http::verb::get,
+      "/",
+      [](const nly::http_server::request_type&) { return nly::make_response_msg("hello"); });
+    server.route(
+      nly::beast_http::verb::post,
+      "/",
+      [](const nly::http_server::request_type& req) { return nly::make_response_msg(req.body()); });
+    if (!server.start(*nly::make_tcp_endpoint("127.0.0.1", 0)))
+    {
+      std::cerr << "can't start the server" << std::endl;
+      return 1;
+    }
+    opt.url = "http://127.0.0.1:" + std::to_string(server.local_endpoint().port()) + "/";
+  }
+
+  if (opt.url.empty())
+  {
+    return usage();
+  }
+
+  auto result = nly::load_generator(opt).run();
+  if (!result)
+  {
+    std::cerr << "can't connect to " << opt.url << std::endl;
+    return 1;
+  }
+
+  auto json = result->to_json();
+  std::cout << json;
+  if (!output.empty())
+  {
+    std::ofstream(output) << json;
+  }
+  return 0;
+}